@@ -0,0 +1,15 @@
+# Storage order of the grid (--layout) against row-major at 1500, 10k and
+# 50k columns, the wide grids hold 10M cells
+layouts="rows morton hilbert"
+sizes="1500x1500 1000x10000 200x50000"
+steps=30
+
+echo "Running layout benchmarks. This may take a while..."
+for size in $sizes; do
+    rows=${size%x*}
+    cols=${size#*x}
+    for l in $layouts; do
+        bench "./build/main-omp $rows $cols f --steps=$steps --layout=$l" --output benchmark/layout_${l}_${cols}.html
+    done
+    echo "[INFO] Done with width $cols"
+done
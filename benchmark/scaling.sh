@@ -0,0 +1,194 @@
+#!/bin/bash
+# Strong and weak scaling of the OpenMP, MPI and hybrid backends.
+#
+# Runs each backend over a sweep of ranks and threads with explicit
+# affinity, REPEATS times per configuration, and takes the mean step time
+# of every run from its telemetry ring (--telemetry, read with
+# build/covidsim-top), so process start, MPI init and the grid setup are
+# left out; with several ranks, that of the slowest one. Writes under OUT:
+#   runs.csv     one line per run
+#   scaling.csv  per configuration, the median step time, speedup and efficiency
+#   scaling.tex  the same as tables for report/report.tex (\input it)
+#   machine.txt  lscpu, compiler, MPI and the settings of the sweep
+#   logs/        the OpenMP and MPI binding reports of every configuration
+#
+# Strong scaling keeps the STRONG grid. Weak scaling gives each worker
+# (rank x thread) WEAK_ROWS rows of WEAK_COLS columns. Both are measured
+# against the 1 worker run of the same backend: the speedup is t1 / tN
+# and the efficiency t1 / (N tN) for strong scaling, and N t1 / tN and
+# t1 / tN for weak scaling.
+#
+# BIND=cores pins each thread, and each rank with its threads, to its own
+# cores, close together; BIND=sockets spreads them over the sockets and
+# lets them move inside one; BIND=none leaves them to the OS. SMT=off
+# places them on physical cores only, SMT=on on every hardware thread.
+# Configurations with more workers than MAX_WORKERS (the cores, or the
+# hardware threads with SMT=on) are skipped.
+#
+# Usage: make bench-scaling, or bash benchmark/scaling.sh with an
+# optimized build/ (settings below, from the environment)
+
+BUILD=${BUILD:-build}
+OUT=${OUT:-benchmark/scaling}
+BACKENDS=${BACKENDS:-"omp mpi hyb"}
+MODES=${MODES:-"strong weak"}
+RANKS=${RANKS:-"1 2 4 8 16 32 64"}
+THREADS=${THREADS:-"1 2 4 8 16 32 64"}
+STRONG=${STRONG:-1500x1500}
+WEAK_ROWS=${WEAK_ROWS:-256}
+WEAK_COLS=${WEAK_COLS:-1500}
+STEPS=${STEPS:-50}
+REPEATS=${REPEATS:-5}
+SEED=${SEED:-31415926}
+BIND=${BIND:-cores}
+SMT=${SMT:-off}
+MPIRUN=${MPIRUN:-mpirun}
+
+sockets=$(lscpu -p=SOCKET | grep -v '^#' | sort -u | wc -l)
+cores=$(lscpu -p=SOCKET,CORE | grep -v '^#' | sort -u | wc -l)
+pus=$(lscpu -p=CPU | grep -v '^#' | wc -l)
+if [ $SMT == on ]; then
+    MAX_WORKERS=${MAX_WORKERS:-$pus}
+else
+    MAX_WORKERS=${MAX_WORKERS:-$cores}
+fi
+case $BIND in
+    cores | sockets | none) ;;
+    *) echo "[ERR] BIND must be cores, sockets or none, not '$BIND'" >&2; exit 1 ;;
+esac
+
+NAME=scaling-$$
+trap 'rm -f /dev/shm/covidsim-$NAME*' EXIT
+mkdir -p $OUT/logs
+
+# omp_env <threads>: OpenMP settings of a process with that many threads
+omp_env() {
+    local places=cores
+    [ $SMT == on ] && places=threads
+    case $BIND in
+        cores) echo "OMP_NUM_THREADS=$1 OMP_PLACES=$places OMP_PROC_BIND=close OMP_DISPLAY_AFFINITY=true" ;;
+        sockets) echo "OMP_NUM_THREADS=$1 OMP_PLACES=sockets OMP_PROC_BIND=spread OMP_DISPLAY_AFFINITY=true" ;;
+        none) echo "OMP_NUM_THREADS=$1 OMP_PROC_BIND=false" ;;
+    esac
+}
+
+# mpi_flags <threads>: mpirun mapping and binding of ranks with that many threads each (Open MPI)
+mpi_flags() {
+    local hwthreads="" unit=core
+    [ $SMT == on ] && hwthreads="--use-hwthread-cpus" && unit=hwthread
+    case $BIND in
+        cores) echo "$hwthreads --map-by slot:PE=$1 --bind-to $unit --report-bindings" ;;
+        sockets) echo "$hwthreads --map-by socket --bind-to socket --report-bindings" ;;
+        none) echo "$hwthreads --bind-to none" ;;
+    esac
+}
+
+# configs <backend>: the "ranks threads" pairs to run, 1 worker first
+configs() {
+    echo "1 1"
+    for r in $RANKS; do
+        for t in $THREADS; do
+            [ $((r * t)) -gt 1 ] && [ $((r * t)) -le $MAX_WORKERS ] || continue
+            case $1 in
+                omp) [ $r -eq 1 ] && echo "$r $t" ;;
+                mpi) [ $t -eq 1 ] && echo "$r $t" ;;
+                hyb) echo "$r $t" ;;
+            esac
+        done
+    done
+}
+
+# run <backend> <ranks> <threads> <rows> <cols> <log>: prints the mean step time in ms, of the slowest rank
+run() {
+    local command="$BUILD/main-$1 $4 $5 f --seed=$SEED --steps=$STEPS --telemetry=$NAME:1000000000"
+    rm -f /dev/shm/covidsim-$NAME*
+    if [ $1 == omp ]; then
+        env $(omp_env $3) $command < /dev/null >> $6 2>&1
+    else
+        $MPIRUN -np $2 $(mpi_flags $3) env $(omp_env $3) $command < /dev/null >> $6 2>&1
+    fi || return 1
+    $BUILD/covidsim-top $NAME --once 2> /dev/null |
+        awk '/^ *writer/ { on = 1; next } on && NF == 0 { exit } on && $5 > ms { ms = $5 } END { if (ms == "") exit 1; print ms }'
+}
+
+{
+    echo "# $(date -u '+%Y-%m-%d %H:%M UTC'), $sockets socket(s), $cores core(s), $pus hardware thread(s)"
+    echo "# BIND=$BIND SMT=$SMT MAX_WORKERS=$MAX_WORKERS STEPS=$STEPS REPEATS=$REPEATS STRONG=$STRONG WEAK=${WEAK_ROWS}x${WEAK_COLS}/worker"
+    echo "# $(mpicc --version | head -1)"
+    echo "# $($MPIRUN --version 2> /dev/null | head -1)"
+    lscpu
+} > $OUT/machine.txt
+
+echo "Running scaling benchmarks on $cores cores ($pus hardware threads), BIND=$BIND SMT=$SMT. This may take a while..."
+echo "backend,mode,ranks,threads,workers,rows,cols,repeat,step_ms" > $OUT/runs.csv
+for backend in $BACKENDS; do
+    for mode in $MODES; do
+        configs $backend | while read ranks threads; do
+            workers=$((ranks * threads))
+            if [ $mode == strong ]; then
+                rows=${STRONG%x*}
+                cols=${STRONG#*x}
+            else
+                rows=$((WEAK_ROWS * workers))
+                cols=$WEAK_COLS
+            fi
+            log=$OUT/logs/$backend-$mode-${ranks}x$threads.log
+            : > $log
+            for repeat in $(seq $REPEATS); do
+                if ms=$(run $backend $ranks $threads $rows $cols $log); then
+                    echo "$backend,$mode,$ranks,$threads,$workers,$rows,$cols,$repeat,$ms" >> $OUT/runs.csv
+                else
+                    echo "[WARN] main-$backend with $ranks rank(s) x $threads thread(s) failed, see $log" >&2
+                fi
+            done
+        done
+        echo "[INFO] Done with $mode scaling of main-$backend"
+    done
+done
+
+# Median of the repeats of each configuration, against the 1 worker one
+sort -t, -k1,1 -k2,2 -k5,5n -k3,3n -k9,9g <(tail -n +2 $OUT/runs.csv) | awk -F, '
+    function flush() {
+        if (n == 0)
+            return
+        median = n % 2 ? t[(n + 1) / 2] : (t[n / 2] + t[n / 2 + 1]) / 2
+        if (key[5] == 1)
+            base = median
+        speedup = base / median
+        if (key[2] == "strong")
+            efficiency = speedup / key[5]
+        else {
+            efficiency = speedup
+            speedup *= key[5]
+        }
+        printf "%s,%s,%s,%s,%s,%s,%s,%d,%.4f,%.4f,%.4f,%.3f,%.3f\n", key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+            n, median, t[1], t[n], speedup, efficiency
+        n = 0
+    }
+    BEGIN { print "backend,mode,ranks,threads,workers,rows,cols,runs,median_ms,min_ms,max_ms,speedup,efficiency" }
+    { id = $1 "," $2 "," $3 "," $4 }
+    id != last { flush(); split($0, key, ","); last = id }
+    { t[++n] = $9 }
+    END { flush() }' > $OUT/scaling.csv
+
+# One table per backend and mode, in the style of the report
+awk -F, -v bind=$BIND -v smt=$SMT '
+    BEGIN { name["omp"] = "OpenMP"; name["mpi"] = "MPI"; name["hyb"] = "MPI + OpenMP"; mode["strong"] = "fuerte"; mode["weak"] = "débil" }
+    function close_table() {
+        if (open)
+            printf "        \\end{tabular}\n    \\end{center}\n\\end{table}\n\n"
+        open = 0
+    }
+    NR == 1 { next }
+    $1 "," $2 != last {
+        close_table()
+        last = $1 "," $2
+        open = 1
+        printf "\\begin{table}[H]\n    \\begin{center}\n        \\begin{tabular}{|c|c|c|c|c|c|}\n            \\hline\n"
+        printf "            \\multicolumn{6}{|c|}{\\textbf{%s, escalado %s (BIND=%s, SMT=%s)}} \\\\ \\hline\n", name[$1], mode[$2], bind, smt
+        printf "            \\textbf{Procesos} & \\textbf{Hilos} & \\textbf{Matriz} & \\textbf{Paso (ms)} & \\textbf{Speedup} & \\textbf{Eficiencia} \\\\ \\hline\n"
+    }
+    { printf "            %s & %s & %s$\\times$%s & %.3f & %.2f & %.2f \\\\ \\hline\n", $3, $4, $6, $7, $9, $12, $13 }
+    END { close_table() }' $OUT/scaling.csv > $OUT/scaling.tex
+
+echo "[INFO] Results in $OUT/scaling.csv and $OUT/scaling.tex"
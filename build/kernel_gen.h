@@ -0,0 +1,16 @@
+/* Generated by rules/gen_kernel.sh from rules/default.rules, do not edit */
+#define SPEC_COLS 64
+#define SPEC_COLS_POW2 1
+#define SPEC_SUSCEPTIBILITY_CHILD 30
+#define SPEC_SUSCEPTIBILITY_ADULT 50
+#define SPEC_SUSCEPTIBILITY_ELDER 90
+#define SPEC_RISK_SUSCEPTIBILITY 15
+#define SPEC_CONTAGIOUS_AFTER 4
+#define SPEC_ISOLATION_AFTER 2
+#define SPEC_ISOLATION_CHANCE 90
+#define SPEC_RESOLUTION_AFTER 14
+#define SPEC_DISEASE_STRENGTH 2.4
+#define SPEC_DEATH_CHANCE_CHILD 1.0
+#define SPEC_DEATH_CHANCE_ADULT 1.3
+#define SPEC_DEATH_CHANCE_ELDER 14.8
+#define SPEC_VACCINE_PROTECTION 0.5
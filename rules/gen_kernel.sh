@@ -0,0 +1,60 @@
+#!/bin/bash
+# Emits the constants of a specialized kernel (see src/kernel_spec.h) for a
+# grid of <cols> columns and the rule spec <spec>. Every rule must be set
+# in the spec, unknown rules are an error. The mobility_* rules don't
+# change the kernel and may be left out.
+#
+# Usage: bash rules/gen_kernel.sh <spec> <cols> > build/kernel_gen.h
+
+SPEC=$1
+COLS=$2
+INT_RULES="susceptibility_child susceptibility_adult susceptibility_elder risk_susceptibility
+           contagious_after isolation_after isolation_chance resolution_after"
+REAL_RULES="disease_strength death_chance_child death_chance_adult death_chance_elder vaccine_protection"
+# Long-range contacts are drawn outside the kernels (see src/mobility.h)
+OTHER_RULES="mobility_rate mobility_radius mobility_exponent mobility_infection"
+
+if [ ! -f "$SPEC" ] || ! [[ "$COLS" =~ ^[0-9]+$ ]] || [ "$COLS" -lt 2 ]; then
+    echo "[ERR] Usage: $0 <spec> <cols>" >&2
+    exit 1
+fi
+
+declare -A value
+line_n=0
+while IFS= read -r line || [ -n "$line" ]; do
+    line_n=$((line_n + 1))
+    line=${line%%#*}
+    [[ "$line" =~ ^[[:space:]]*$ ]] && continue
+    if ! [[ "$line" =~ ^[[:space:]]*([a-z_]+)[[:space:]]*=[[:space:]]*([-+0-9.eE]+)[[:space:]]*$ ]]; then
+        echo "[ERR] $SPEC:$line_n: expected 'key = value'" >&2
+        exit 1
+    fi
+    value[${BASH_REMATCH[1]}]=${BASH_REMATCH[2]}
+done < "$SPEC"
+
+for key in "${!value[@]}"; do
+    if ! [[ " $INT_RULES $REAL_RULES $OTHER_RULES " =~ [[:space:]]$key[[:space:]] ]]; then
+        echo "[ERR] $SPEC: unknown rule '$key'" >&2
+        exit 1
+    fi
+done
+
+echo "/* Generated by $0 from $SPEC, do not edit */"
+echo "#define SPEC_COLS $COLS"
+echo "#define SPEC_COLS_POW2 $(((COLS & (COLS - 1)) == 0))"
+for key in $INT_RULES $REAL_RULES; do
+    if [ -z "${value[$key]}" ]; then
+        echo "[ERR] $SPEC: missing rule '$key'" >&2
+        exit 1
+    fi
+    if [[ " $INT_RULES " =~ [[:space:]]$key[[:space:]] ]] && ! [[ "${value[$key]}" =~ ^[-+]?[0-9]+$ ]]; then
+        echo "[ERR] $SPEC: '$key' must be an integer" >&2
+        exit 1
+    fi
+    # Reals keep a decimal point so they stay doubles in C
+    v=${value[$key]}
+    if [[ " $REAL_RULES " =~ [[:space:]]$key[[:space:]] ]] && ! [[ "$v" =~ [.eE] ]]; then
+        v="$v.0"
+    fi
+    echo "#define SPEC_${key^^} $v"
+done
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    On-disk cache of finished runs for the daemon (--cache=DIR, see
+    src/daemon.c). A run is keyed by a hash of everything its result
+    depends on: ENGINE_VERSION, the grid size, the seed, the rules and the
+    content of the population raster, but not the number of steps or the
+    kernel, since every kernel computes the same step. Each key has one
+    file, DIR/<key>.run: a RunHeader, the whole grid after the last cached
+    step and the trace of every step up to it (see trace.h).
+
+    A job of at most that many steps is answered from the mapped file. A
+    longer one resumes from the cached grid, the per-cell draws only depend
+    on (seed, time, cell), and replaces the file with its own once done.
+    Files are written aside and renamed, so readers never see half of one.
+    Nothing is ever evicted, remove the files to reclaim space.
+*/
+
+#define CACHE_MAGIC "COVIDRUN"
+
+typedef struct RunHeader
+{
+    char magic[8];
+    int32_t steps; // Of the cached grid, the trace has steps + 1 lines
+    int32_t rows;
+    int32_t cols;
+    int32_t cell_bytes;
+    uint64_t trace_bytes;
+} RunHeader;
+
+typedef struct CachedRun
+{
+    int steps; // -1 when nothing is cached
+    const Cell *grid;
+    const char *trace;
+    void *map;
+    size_t bytes;
+} CachedRun;
+
+uint64_t cache_hash(uint64_t hash, const void *data, size_t n)
+{
+    const uint8_t *bytes = data;
+    for (size_t k = 0; k < n; k++)
+    {
+        hash ^= bytes[k];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/*
+    Key of a run of `opts` under `rules`. Reads the whole population raster
+    if there is one. Returns -1 if it can't be read.
+*/
+int cache_key(const Options *opts, const RuleParams *rules, uint64_t *key)
+{
+    int32_t config[5] = {ENGINE_VERSION, (int32_t)sizeof(Cell), opts->rows, opts->cols, (int32_t)opts->seed};
+    uint64_t hash = cache_hash(0xCBF29CE484222325ULL, config, sizeof(config));
+    // Field by field, padding bytes are undefined
+    hash = cache_hash(hash, &rules->disease_strength, sizeof(double));
+    hash = cache_hash(hash, rules->susceptibility, sizeof(rules->susceptibility));
+    hash = cache_hash(hash, &rules->risk_susceptibility, sizeof(int));
+    hash = cache_hash(hash, &rules->contagious_after, sizeof(int));
+    hash = cache_hash(hash, &rules->isolation_after, sizeof(int));
+    hash = cache_hash(hash, &rules->isolation_chance, sizeof(int));
+    hash = cache_hash(hash, &rules->resolution_after, sizeof(int));
+    hash = cache_hash(hash, rules->death_chance, sizeof(rules->death_chance));
+    hash = cache_hash(hash, &rules->vaccine_protection, sizeof(double));
+    hash = cache_hash(hash, &rules->mobility_rate, sizeof(double));
+    hash = cache_hash(hash, &rules->mobility_radius, sizeof(int));
+    hash = cache_hash(hash, &rules->mobility_exponent, sizeof(double));
+    hash = cache_hash(hash, &rules->mobility_infection, sizeof(int));
+    if (opts->population_path != NULL)
+    {
+        Raster raster;
+        if (raster_open(&raster, opts->population_path, opts->rows, opts->cols) != 0)
+            return -1;
+        hash = cache_hash(hash, raster.map, raster.bytes);
+        raster_close(&raster);
+    }
+    *key = hash;
+    return 0;
+}
+
+void cache_path(const char *root, uint64_t key, const char *suffix, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%016llx%s", root, (unsigned long long)key, suffix);
+}
+
+// Lines of the `n` bytes of `trace`, only counting those ended by a newline
+size_t cache_trace_lines(const char *trace, size_t n)
+{
+    size_t lines = 0;
+    for (const char *end = trace; (end = memchr(end, '\n', n - (size_t)(end - trace))) != NULL; end++)
+        lines++;
+    return lines;
+}
+
+/*
+    Maps the run cached under `key` in `root`, if any and if it is for a
+    `rows` x `cols` grid. `run->steps` is -1 when there is none, or when
+    the file is truncated or isn't a run of ours.
+*/
+void cache_open(CachedRun *run, const char *root, uint64_t key, int rows, int cols)
+{
+    run->steps = -1;
+    run->map = NULL;
+    char path[4096];
+    cache_path(root, key, ".run", path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0)
+        return;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(RunHeader))
+    {
+        run->bytes = (size_t)st.st_size;
+        run->map = mmap(NULL, run->bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (run->map == NULL || run->map == MAP_FAILED)
+    {
+        run->map = NULL;
+        return;
+    }
+    const RunHeader *header = run->map;
+    size_t grid_bytes = (size_t)rows * (size_t)cols * sizeof(Cell);
+    if (memcmp(header->magic, CACHE_MAGIC, 8) != 0 || header->rows != rows || header->cols != cols ||
+        header->cell_bytes != (int32_t)sizeof(Cell) || header->steps < 0 || header->trace_bytes > run->bytes ||
+        run->bytes != sizeof(RunHeader) + grid_bytes + header->trace_bytes)
+        return;
+    // cache_trace_bytes() relies on one line per step
+    const char *trace = (const char *)run->map + sizeof(RunHeader) + grid_bytes;
+    if (cache_trace_lines(trace, header->trace_bytes) != (size_t)header->steps + 1)
+        return;
+    run->steps = header->steps;
+    run->grid = (const Cell *)((const char *)run->map + sizeof(RunHeader));
+    run->trace = trace;
+}
+
+void cache_close(CachedRun *run)
+{
+    if (run->map != NULL)
+        munmap(run->map, run->bytes);
+}
+
+// Bytes of the cached trace up to step `steps` included
+size_t cache_trace_bytes(const CachedRun *run, int steps)
+{
+    const char *end = run->trace;
+    const char *last = (const char *)run->map + run->bytes;
+    for (int k = 0; k <= steps; k++)
+        end = (const char *)memchr(end, '\n', (size_t)(last - end)) + 1;
+    return (size_t)(end - run->trace);
+}
+
+/*
+    Caches `grid`, a `rows` x `cols` grid after `steps` steps, with the
+    `trace` of its steps under `key` in `root`. Returns -1 on error.
+*/
+int cache_store(const char *root, uint64_t key, const Cell *grid, int rows, int cols, int steps,
+                const char *trace, size_t trace_bytes)
+{
+    char path[4096], temp[4096 + 32];
+    cache_path(root, key, ".run", path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.%ld", path, (long)getpid());
+    FILE *f = fopen(temp, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't write to the cache '%s'\n", root);
+        return -1;
+    }
+    RunHeader header = {.steps = steps, .rows = rows, .cols = cols, .cell_bytes = (int32_t)sizeof(Cell),
+                        .trace_bytes = trace_bytes};
+    memcpy(header.magic, CACHE_MAGIC, 8);
+    size_t n_cells = (size_t)rows * (size_t)cols;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(grid, sizeof(Cell), n_cells, f) == n_cells &&
+              fwrite(trace, 1, trace_bytes, f) == trace_bytes;
+    if (fclose(f) != 0 || !ok || rename(temp, path) != 0)
+    {
+        fprintf(stderr, "[ERR] Can't write to the cache '%s'\n", root);
+        unlink(temp);
+        return -1;
+    }
+    return 0;
+}
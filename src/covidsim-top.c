@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "simulation.h"
+#include "trace.h"
+#include "telemetry.h"
+
+/*
+    Live view of a run started with --telemetry=NAME (see telemetry.h).
+    Maps the rings of every writer read-only and, every --interval
+    milliseconds, reads the records published since the previous refresh:
+    step rate, cell throughput, step latency and the share of it spent
+    waiting, per writer, the latency histogram of all writers and the
+    latest status counts. --once prints one report over the whole ring
+    and exits.
+*/
+
+#define TOP_USAGE "Usage: %s <name> [--interval=MS] [--once]\n"
+#define TOP_MAX_WRITERS 1024
+#define TOP_BUCKETS 24 // Latency histogram, powers of 2 from 1 us
+
+typedef struct Ring
+{
+    const TelemetryHeader *header;
+    const TelemetryRecord *ring;
+    uint64_t read; // Records read so far
+    bool has_last;
+    TelemetryRecord last;
+} Ring;
+
+typedef struct Window
+{
+    int64_t steps;
+    int64_t first_ns; // End of the step before the first one read
+    int64_t last_ns;
+    int64_t step_ns;
+    int64_t update_ns;
+} Window;
+
+// Maps the ring at `path`. Returns -1 if there is none.
+int ring_open(Ring *ring, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    size_t bytes = sizeof(TelemetryHeader) + TELEMETRY_SLOTS * sizeof(TelemetryRecord);
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == bytes)
+        map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    ring->header = map;
+    ring->ring = (const TelemetryRecord *)((const char *)map + sizeof(TelemetryHeader));
+    ring->read = 0;
+    ring->has_last = false;
+    if (memcmp(ring->header->magic, TELEMETRY_MAGIC, 8) != 0 || ring->header->version != TELEMETRY_VERSION)
+    {
+        munmap(map, bytes);
+        return -1;
+    }
+    return 0;
+}
+
+// Copies record `n` of `ring` into `out`. False if it was overwritten or is being written.
+bool ring_read(const Ring *ring, uint64_t n, TelemetryRecord *out)
+{
+    const TelemetryRecord *r = &ring->ring[n & (TELEMETRY_SLOTS - 1)];
+    uint64_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+    if (seq != 2 * n + 2)
+        return false;
+    memcpy(out, (const void *)r, sizeof(TelemetryRecord));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq;
+}
+
+// Reads the records of `ring` published since the last call into `win` and `histogram`
+void ring_poll(Ring *ring, Window *win, long *histogram)
+{
+    uint64_t head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+    if (head - ring->read > TELEMETRY_SLOTS)
+        ring->read = head - TELEMETRY_SLOTS;
+    memset(win, 0, sizeof(Window));
+    for (; ring->read < head; ring->read++)
+    {
+        TelemetryRecord r;
+        if (!ring_read(ring, ring->read, &r))
+            continue;
+        if (win->steps == 0)
+            win->first_ns = r.time_ns - r.step_ns;
+        win->steps++;
+        win->last_ns = r.time_ns;
+        win->step_ns += r.step_ns;
+        win->update_ns += r.update_ns;
+        int b = 0;
+        while (b < TOP_BUCKETS - 1 && (r.step_ns >> 10) >> b > 0)
+            b++;
+        histogram[b]++;
+        ring->last = r;
+        ring->has_last = true;
+    }
+}
+
+// Prints `count` as a bar `width` wide at most, scaled by `max`
+void print_bar(long count, long max, int width)
+{
+    int n = max > 0 ? (int)((double)count * width / (double)max + 0.5) : 0;
+    for (int k = 0; k < n; k++)
+        putchar('#');
+}
+
+void top_report(Ring *rings, int n_rings, const char *name, bool clear)
+{
+    long histogram[TOP_BUCKETS] = {0};
+    int64_t counts[STATUS_KINDS] = {0};
+    int64_t counts_step = -1;
+    const TelemetryHeader *h = rings[0].header;
+    if (clear)
+        printf("\033[H\033[2J");
+    printf("covidsim-top: %s, %d writer%s, %dx%d grid\n\n", name, n_rings, n_rings > 1 ? "s" : "", h->rows, h->cols);
+    printf("%6s %8s %10s %10s %10s %7s %s\n", "writer", "step", "steps/s", "Mcells/s", "step ms", "wait %", "state");
+    for (int w = 0; w < n_rings; w++)
+    {
+        Window win;
+        ring_poll(&rings[w], &win, histogram);
+        double seconds = (double)(win.last_ns - win.first_ns) * 1e-9;
+        double rate = seconds > 0 ? (double)win.steps / seconds : 0;
+        const TelemetryRecord *last = &rings[w].last;
+        bool alive = kill((pid_t)rings[w].header->pid, 0) == 0;
+        printf("%6d %8lld %10.1f %10.2f %10.3f %7.1f %s\n", rings[w].header->rank,
+               rings[w].has_last ? (long long)last->step : 0LL, rate, rate * (double)rings[w].header->cells * 1e-6,
+               win.steps > 0 ? (double)win.step_ns * 1e-6 / (double)win.steps : 0,
+               win.step_ns > 0 ? 100.0 * (double)(win.step_ns - win.update_ns) / (double)win.step_ns : 0,
+               alive ? "running" : "finished");
+        if (rings[w].has_last && last->counts_step >= 0)
+        {
+            for (int k = 0; k < STATUS_KINDS; k++)
+                counts[k] += last->counts[k];
+            counts_step = counts_step < 0 ? last->counts_step : MIN(counts_step, last->counts_step);
+        }
+    }
+
+    long max = 0;
+    for (int b = 0; b < TOP_BUCKETS; b++)
+        max = MAX(max, histogram[b]);
+    printf("\nStep latency\n");
+    for (int b = 0; b < TOP_BUCKETS; b++)
+    {
+        if (histogram[b] == 0)
+            continue;
+        printf("  < %8.3f ms %8ld ", (double)(1L << (b + 10)) * 1e-6, histogram[b]);
+        print_bar(histogram[b], max, 40);
+        printf("\n");
+    }
+
+    int64_t total = 0;
+    for (int k = 0; k < STATUS_KINDS; k++)
+        total += counts[k];
+    const char *names[STATUS_KINDS] = {"empty", "susc", "sick_nc", "sick_c", "isolated", "cured", "dead"};
+    printf("\nCells at step %lld\n", (long long)counts_step);
+    for (int k = 0; k < STATUS_KINDS; k++)
+    {
+        printf("  %-8s %12lld ", names[k], (long long)counts[k]);
+        print_bar((long)counts[k], (long)total, 40);
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, TOP_USAGE, argv[0]);
+        return -1;
+    }
+    const char *name = argv[1];
+    int interval_ms = 500;
+    bool once = false;
+    for (int k = 2; k < argc; k++)
+    {
+        if (strncmp(argv[k], "--interval=", strlen("--interval=")) == 0)
+            interval_ms = MAX(atoi(argv[k] + strlen("--interval=")), 10);
+        else if (strcmp(argv[k], "--once") == 0)
+            once = true;
+        else
+        {
+            fprintf(stderr, "[ERR] Unknown option '%s'\n" TOP_USAGE, argv[k], argv[0]);
+            return -1;
+        }
+    }
+
+    // A single writer, or one per MPI rank
+    Ring *rings = malloc(TOP_MAX_WRITERS * sizeof(Ring));
+    int n_rings = 0;
+    char path[4096 + 64];
+    telemetry_path(name, 0, 1, path, sizeof(path));
+    if (ring_open(&rings[0], path) == 0)
+        n_rings = 1;
+    else
+    {
+        for (int r = 0; r < TOP_MAX_WRITERS; r++)
+        {
+            telemetry_path(name, r, 2, path, sizeof(path));
+            if (ring_open(&rings[n_rings], path) != 0)
+                break;
+            n_rings++;
+        }
+    }
+    if (n_rings == 0)
+    {
+        telemetry_path(name, 0, 1, path, sizeof(path));
+        fprintf(stderr, "[ERR] No telemetry ring at '%s' or '%s.0'\n", path, path);
+        free(rings);
+        return -1;
+    }
+
+    top_report(rings, n_rings, name, !once);
+    while (!once)
+    {
+        usleep((useconds_t)interval_ms * 1000);
+        top_report(rings, n_rings, name, true);
+    }
+    free(rings);
+    return 0;
+}
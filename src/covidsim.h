@@ -0,0 +1,79 @@
+#ifndef COVIDSIM_H
+#define COVIDSIM_H
+
+#include <stdint.h>
+
+/*
+    Public interface of libcovidsim (build/libcovidsim.so, see
+    src/libcovidsim.c): the engine of the backends behind create, step,
+    run and snapshot calls, for hosts such as analysis scripts or a Python
+    extension. Unlike the other headers of src/ this one only declares.
+
+    The state is read in place: covidsim_status() points at a plane of one
+    status code per cell and covidsim_counts() at the counts of the current
+    step, both updated by every step at the same addresses. The counts of
+    every step are kept as columns, one array per status, that a host can
+    wrap (a numpy array, an Arrow column) without copying. Pointers into
+    the series stay valid until the next step, which may move them.
+
+    Status codes follow the columns of the traces (see trace.h). The rules
+    are process-wide in the engine, each call installs the ones of its
+    simulation, so simulations must not step concurrently.
+*/
+
+#define COVIDSIM_STATUS_KINDS 7
+#define COVIDSIM_API __attribute__((visibility("default"))) // The library is built with the rest hidden
+
+enum
+{
+    COVIDSIM_EMPTY,
+    COVIDSIM_SUSCEPTIBLE,
+    COVIDSIM_SICK_NOT_CONTAGIOUS,
+    COVIDSIM_SICK_CONTAGIOUS,
+    COVIDSIM_ISOLATED,
+    COVIDSIM_CURED,
+    COVIDSIM_DEAD
+};
+
+typedef struct CovidSim CovidSim;
+
+typedef struct CovidConfig
+{
+    int rows;
+    int cols;
+    unsigned int seed;           // Same seed, same run as the backends
+    const char *rules_path;      // Rule spec, NULL for the default rules
+    const char *population_path; // Population raster, NULL draws the grid
+    const char *kernel;          // Row kernel, NULL picks the fastest
+    int threads;                 // OpenMP threads, 0 for the default
+} CovidConfig;
+
+typedef struct CovidSeries
+{
+    int64_t length;                               // Steps recorded, step 0 included
+    const int64_t *counts[COVIDSIM_STATUS_KINDS]; // One column per status, `length` values each
+} CovidSeries;
+
+// A new simulation at step 0, NULL on error (printed on stderr)
+COVIDSIM_API CovidSim *covidsim_create(const CovidConfig *config);
+COVIDSIM_API void covidsim_destroy(CovidSim *sim);
+
+// Advances one step, or `steps` steps. Return -1 on error.
+COVIDSIM_API int covidsim_step(CovidSim *sim);
+COVIDSIM_API int covidsim_run(CovidSim *sim, int steps);
+
+COVIDSIM_API int covidsim_time(const CovidSim *sim);
+COVIDSIM_API int covidsim_rows(const CovidSim *sim);
+COVIDSIM_API int covidsim_cols(const CovidSim *sim);
+
+// rows x cols status codes, row-major
+COVIDSIM_API const uint8_t *covidsim_status(const CovidSim *sim);
+// COVIDSIM_STATUS_KINDS counts of the current step
+COVIDSIM_API const int64_t *covidsim_counts(const CovidSim *sim);
+// Columns of the counts of every step so far
+COVIDSIM_API void covidsim_series(const CovidSim *sim, CovidSeries *series);
+
+// Writes the grid like --dump does. Returns -1 on error.
+COVIDSIM_API int covidsim_snapshot(const CovidSim *sim, const char *path);
+
+#endif
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#include "utils.h"
+#include "simulation.h"
+#include "options.h"
+#include "trace.h"
+#include "engine.h"
+#include "raster.h"
+#include "mobility.h"
+#include "pool.h"
+#include "cache.h"
+
+/*
+    Simulation daemon: runs jobs sent over a Unix socket on one resident
+    OpenMP team, so a job doesn't pay for process start, MPI or SDL init
+    and grid allocation (buffers come from a GridPool, see pool.h).
+
+    A job is one line holding the command line of a backend without the
+    program name ("<rows> <cols> f [options]"). The daemon answers with
+    the trace of the run as it goes (see trace.h), one line per step,
+    then "# done" or "# failed" after the [ERR] lines of the error. Jobs
+    run one at a time, in the order they connect, each on every thread.
+    --dump=FILE writes the final grid on the daemon's side. The line
+    "shutdown" stops the daemon. See src/submit.c for a client.
+
+    Jobs run the double buffered row-major engine with any kernel, rule
+    spec and population raster. With --cache=DIR finished runs are kept
+    in DIR and repeated or extended jobs start from them (see cache.h).
+*/
+
+#define DAEMON_USAGE "Usage: %s <socket> [--threads=N] [--cache=DIR]\n"
+#define DAEMON_LINE 4096
+#define DAEMON_ARGS 64
+
+// Traces step `step` to the client and, when caching, to `record`
+void job_trace(FILE *out, FILE *record, int step, const Cell *matrix, int w, int h)
+{
+    TraceSum sum;
+    trace_begin(&sum);
+    trace_add(&sum, matrix, (size_t)w * (size_t)h);
+    trace_end(out, step, &sum);
+    if (record != NULL)
+        trace_end(record, step, &sum);
+}
+
+/*
+    Runs the job of `line`, streaming its trace to `out`, from the runs
+    cached in `cache_root` unless it is NULL. Errors go to stderr. Returns
+    -1 on error.
+*/
+int job_run(GridPool *pool, const char *cache_root, char *line, FILE *out)
+{
+    char const *argv[DAEMON_ARGS];
+    int argc = split_command_line(line, "daemon", argv, DAEMON_ARGS);
+    Options opts;
+    if (parse_options(argc, argv, &opts, false) != 0)
+        return -1;
+    int rows = opts.rows;
+    int cols = opts.cols;
+    if (opts.use_gui || opts.rolling || opts.tile_size > 0 || opts.graph_path != NULL || opts.trace_path != NULL ||
+        opts.sync_neighbors || opts.telemetry != NULL || (opts.layout != NULL && strcmp(opts.layout, "rows") != 0))
+    {
+        fprintf(stderr, "[ERR] Jobs run double buffered and row-major, without the GUI, --tiles, --graph, --trace, "
+                        "--sync or --telemetry\n");
+        return -1;
+    }
+
+    // Every job starts from the default rules
+    rule_params = (RuleParams)RULES_DEFAULT;
+    if (opts.rules_path != NULL && load_rules(opts.rules_path, &rule_params) != 0)
+        return -1;
+    if (mobility_enabled())
+    {
+        fprintf(stderr, "[ERR] The daemon doesn't run the mobility rules\n");
+        return -1;
+    }
+    KernelKind kernel_kind;
+    if (kernel_select(opts.kernel, cols, &kernel_kind) != 0)
+        return -1;
+    RowKernel kernel = kernel_table[kernel_kind];
+
+    uint64_t key = 0;
+    CachedRun run = {.steps = -1, .map = NULL};
+    if (cache_root != NULL)
+    {
+        if (cache_key(&opts, &rule_params, &key) != 0)
+            return -1;
+        cache_open(&run, cache_root, key, rows, cols);
+    }
+    fprintf(out, "# step hash empty susc sick_nc sick_c isolated cured dead\n");
+    // Runs as long as the job, or longer without a dump, are answered from the cache
+    if (run.steps >= opts.steps && (opts.dump_path == NULL || run.steps == opts.steps))
+    {
+        fwrite(run.trace, 1, cache_trace_bytes(&run, opts.steps), out);
+        int result = opts.dump_path != NULL ? dump_grid(opts.dump_path, run.grid, cols, rows) : 0;
+        cache_close(&run);
+        return result;
+    }
+
+    size_t n_cells = (size_t)rows * (size_t)cols;
+    Cell *matrix = pool_get(pool, n_cells);
+    Cell *upd_matrix = pool_get(pool, n_cells);
+    if (matrix == NULL || upd_matrix == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't allocate a %dx%d grid\n", rows, cols);
+        pool_put(pool, matrix, n_cells);
+        pool_put(pool, upd_matrix, n_cells);
+        cache_close(&run);
+        return -1;
+    }
+
+    // The trace of the run, kept to cache it
+    char *text = NULL;
+    size_t text_bytes = 0;
+    FILE *record = cache_root != NULL ? open_memstream(&text, &text_bytes) : NULL;
+
+    int result = 0;
+    int first_step = 0;
+    if (run.steps > 0 && run.steps < opts.steps)
+    {
+        // Resumes the shorter cached run
+        memcpy(matrix, run.grid, n_cells * sizeof(Cell));
+        first_step = run.steps;
+        size_t prefix = cache_trace_bytes(&run, run.steps);
+        fwrite(run.trace, 1, prefix, out);
+        fwrite(run.trace, 1, prefix, record);
+    }
+    else
+    {
+        srand(opts.seed);
+        if (opts.population_path == NULL)
+            init_cell_matrix(matrix, cols, rows);
+        else if (raster_load_rows(opts.population_path, matrix, rows, cols, 0, rows) != 0)
+            result = -1;
+        if (result == 0)
+            job_trace(out, record, 0, matrix, cols, rows);
+    }
+    cache_close(&run);
+
+    for (int sim_t = first_step; sim_t < opts.steps && result == 0; sim_t++)
+    {
+#pragma omp parallel for
+        for (int i = 0; i < rows; i++)
+            engine_update_row(kernel, matrix, upd_matrix, cols, rows, i, sim_t, opts.seed, 0);
+        Cell *temp = matrix;
+        matrix = upd_matrix;
+        upd_matrix = temp;
+        job_trace(out, record, sim_t + 1, matrix, cols, rows);
+        // The client reads the steps as they come, and a closed client stops the job
+        if (fflush(out) != 0)
+            result = -1;
+    }
+    if (result == 0 && opts.dump_path != NULL)
+        result = dump_grid(opts.dump_path, matrix, cols, rows);
+    if (record != NULL)
+    {
+        // Only runs longer than the cached one replace it
+        if (fclose(record) == 0 && result == 0 && opts.steps > run.steps)
+            result = cache_store(cache_root, key, matrix, rows, cols, opts.steps, text, text_bytes);
+        free(text);
+    }
+
+    pool_put(pool, matrix, n_cells);
+    pool_put(pool, upd_matrix, n_cells);
+    return result;
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, DAEMON_USAGE, argv[0]);
+        return -1;
+    }
+    const char *socket_path = argv[1];
+    const char *cache_root = NULL;
+    for (int k = 2; k < argc; k++)
+    {
+        if (starts_with(argv[k], "--threads="))
+            omp_set_num_threads(MAX(atoi(argv[k] + strlen("--threads=")), 1));
+        else if (starts_with(argv[k], "--cache="))
+            cache_root = argv[k] + strlen("--cache=");
+        else
+        {
+            fprintf(stderr, "[ERR] Unknown option '%s'\n" DAEMON_USAGE, argv[k], argv[0]);
+            return -1;
+        }
+    }
+
+    if (cache_root != NULL && mkdir(cache_root, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "[ERR] Can't create the cache '%s'\n", cache_root);
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "[ERR] Socket path too long: '%s'\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (server < 0 || bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 128) != 0)
+    {
+        fprintf(stderr, "[ERR] Can't listen on '%s'\n", socket_path);
+        return -1;
+    }
+    // A client leaving early must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    // Starts the team once, later jobs find it ready
+#pragma omp parallel
+    {
+        DEBUG_PRINT("Thread %d of %d ready\n", omp_get_thread_num(), omp_get_num_threads());
+    }
+    DEBUG_PRINT("Listening on %s\n", socket_path);
+
+    GridPool pool;
+    pool_init(&pool);
+    int saved_stderr = dup(STDERR_FILENO);
+    bool running = true;
+    long jobs = 0;
+    while (running)
+    {
+        int client = accept(server, NULL, NULL);
+        if (client < 0)
+            continue;
+        FILE *in = fdopen(client, "r");
+        FILE *out = fdopen(dup(client), "w");
+        char line[DAEMON_LINE];
+        if (in != NULL && out != NULL && fgets(line, sizeof(line), in) != NULL)
+        {
+            if (strncmp(line, "shutdown", 8) == 0)
+            {
+                running = false;
+                fprintf(out, "# done\n");
+            }
+            else
+            {
+                // Errors of the job go to its client
+                dup2(fileno(out), STDERR_FILENO);
+                int result = job_run(&pool, cache_root, line, out);
+                fflush(out);
+                dup2(saved_stderr, STDERR_FILENO);
+                fprintf(out, result == 0 ? "# done\n" : "# failed\n");
+                jobs++;
+            }
+        }
+        if (in != NULL)
+            fclose(in);
+        else
+            close(client);
+        if (out != NULL)
+            fclose(out);
+    }
+
+    DEBUG_PRINT("Ran %ld jobs, reused %zu buffers and allocated %zu\n", jobs, pool.reused, pool.allocated);
+    pool_free(&pool);
+    close(saved_stderr);
+    close(server);
+    unlink(socket_path);
+    return 0;
+}
@@ -0,0 +1,467 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#include <sched.h>
+#endif
+
+/*
+    Step engine shared by every backend.
+
+    A kernel updates one row of the grid: `above`, `row` and `below` hold
+    the previous state of the row and of its vertical neighbors and `out`
+    receives the new state. Columns wrap around. `cell_base` is the global
+    index of row[0] and seeds the per-cell random numbers, so a row gives
+    the same result wherever it is computed.
+
+    All kernels compute exactly the same step. The SIMD ones are the same
+    chunked code compiled for a wider instruction set, chosen at startup
+    from what the CPU supports (or forced with --kernel). Builds with
+    SPEC=t add a kernel specialized for one width and rule spec (see
+    kernel_spec.h), preferred whenever the grid and the rules match.
+*/
+
+#define KERNEL_CHUNK 1024
+// Bump whenever a change alters the step, it invalidates the runs cached by the daemon (see cache.h)
+#define ENGINE_VERSION 1
+
+typedef void (*RowKernel)(Cell *above, Cell *row, Cell *below, Cell *out,
+                          int cols, int time, uint64_t seed, uint64_t cell_base);
+
+typedef enum KernelKind
+{
+    KERNEL_SCALAR = 0,
+    KERNEL_SSE42 = 1,
+    KERNEL_AVX2 = 2,
+    KERNEL_AVX512 = 3,
+    KERNEL_SPECIALIZED = 4,
+    KERNEL_KINDS = 5
+} KernelKind;
+
+const char *kernel_names[KERNEL_KINDS] = {"scalar", "sse4.2", "avx2", "avx512", "specialized"};
+
+// Reference kernel, straight from the rules in simulation.h
+void kernel_scalar(Cell *above, Cell *row, Cell *below, Cell *out,
+                   int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    Cell *buff_neighbors[8];
+    for (int j = 0; j < cols; j++)
+    {
+        out[j] = row[j];
+        int inf_n = 0;
+        if (row[j].status == SUSC_BLUE)
+        {
+            row_neighbors(above, row, below, cols, j, buff_neighbors);
+            inf_n = infected_neighbors(buff_neighbors);
+        }
+        CellRng rng;
+        cell_rng_seed(&rng, seed, time, cell_base + (uint64_t)j);
+        apply_rules(&out[j], inf_n, time, &rng);
+    }
+}
+
+// Draw `k` (from 1) of a cell seeded with `state0`, what its k-th cell_rand() returns
+static inline __attribute__((always_inline)) int32_t kernel_draw(uint64_t state0, uint64_t k)
+{
+    uint64_t z = state0 + k * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (int32_t)((z ^ (z >> 31)) >> 33);
+}
+
+// `a` where `mask` is all ones, `b` where it is 0
+static inline __attribute__((always_inline)) int32_t kernel_blend(int32_t mask, int32_t a, int32_t b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+/*
+    apply_rules() on `len` cells of `row` into `out`, without branches on
+    the status (make BRANCHLESS=t). Drawing is what makes the rules
+    expensive per cell, and few cells need a number:
+
+    - The first pass runs every rule that needs no draw value over the
+      whole chunk with selects only, so it vectorizes with the neighbor
+      counts. The susceptible rule only consumes a draw: its random term
+      ((rand % 100) / 100) is always 0, whether the cell gets sick only
+      depends on a full neighborhood, the age and the risk, a bit of
+      `sick_bits` computed once per chunk.
+    - It flags the cells due to isolate or resolve, which need the value
+      of their draw, and a second pass draws their numbers in a batch from
+      the counter of each cell (the rules that drew before a rule tell
+      which draw it takes) and blends in the outcomes.
+*/
+static inline __attribute__((always_inline)) void kernel_rules(const Cell *row, Cell *out, const int32_t *inf_n,
+                                                               int len, int time, uint64_t seed, uint64_t cell_base)
+{
+    int32_t status[KERNEL_CHUNK];
+    int32_t contagion_t[KERNEL_CHUNK];
+    int32_t sick_if[KERNEL_CHUNK]; // All ones if the cell gets sick when it draws to
+    int32_t drawing[KERNEL_CHUNK]; // Bit 0: draws to get sick, 1: to isolate, 2: to resolve
+    int32_t pending[KERNEL_CHUNK]; // Cells with a draw value to use
+    // Locals, so the stores to `out` can't alias them
+    const RuleParams p = rule_params;
+    const double death_by_age[4] = {p.death_chance[CHILD], p.death_chance[ADULT], p.death_chance[ELDER], 0};
+    uint64_t by_time = (uint64_t)time;
+    uint64_t seed_time = seed ^ splitmix64(&by_time);
+
+    // Bit (full * 8 + age * 2 + risk), unknown ages count as 0 like in the rules
+    uint32_t sick_bits = 0;
+    for (uint32_t bit = 0; bit < 16; bit++)
+    {
+        uint32_t age = (bit >> 1) & 3;
+        int susc = (age < 3 ? p.susceptibility[age] : 0) + (int)(bit & 1) * p.risk_susceptibility;
+        double get_sick_chance = ((int)(bit >> 3) * p.disease_strength) + (susc / 100);
+        sick_bits |= (uint32_t)(0 < get_sick_chance) << bit;
+    }
+
+    // What the rules read of each cell, as arrays
+    for (int k = 0; k < len; k++)
+    {
+        status[k] = (int32_t)row[k].status;
+        contagion_t[k] = row[k].contagion_t;
+        uint32_t bit = (uint32_t)(inf_n[k] / 8) * 8 + MIN((uint32_t)row[k].age, 3u) * 2 +
+                       (uint32_t)(row[k].risk_disease | row[k].risk_job);
+        sick_if[k] = -(int32_t)((sick_bits >> bit) & 1);
+    }
+
+    for (int k = 0; k < len; k++)
+    {
+        int32_t s = status[k];
+        int32_t t = contagion_t[k];
+        int32_t draws_sick = -((s == SUSC_BLUE) & (inf_n[k] != 0));
+        int32_t gets_sick = draws_sick & sick_if[k];
+        s = kernel_blend(gets_sick, SICK_NC_ORANGE, s);
+        t = kernel_blend(gets_sick, time, t);
+
+        int32_t elapsed = time - t;
+        s = kernel_blend(-((s == SICK_NC_ORANGE) & (elapsed == p.contagious_after)), SICK_C_RED, s);
+        int32_t isolates = (s == SICK_C_RED) & (elapsed == p.isolation_after);
+        // Isolating keeps the cell sick, so resolving doesn't depend on the isolation draw
+        int32_t resolves = ((s == SICK_NC_ORANGE) | (s == SICK_C_RED) | (s == ISOLATED_YELLOW)) &
+                           (elapsed == p.resolution_after);
+        status[k] = s;
+        contagion_t[k] = t;
+        drawing[k] = (draws_sick & 1) | isolates << 1 | resolves << 2;
+    }
+
+    int n_pending = 0;
+    for (int k = 0; k < len; k++)
+    {
+        pending[n_pending] = k;
+        n_pending += drawing[k] > 1;
+    }
+    for (int q = 0; q < n_pending; q++)
+    {
+        int k = pending[q];
+        uint64_t state0 = seed_time ^ ((cell_base + (uint64_t)k) * 0xD6E8FEB86659FD93ULL);
+        int32_t isolates = -((drawing[k] >> 1) & 1);
+        int32_t resolves = -((drawing[k] >> 2) & 1);
+        uint64_t first = (uint64_t)(drawing[k] & 1) + 1;
+        int32_t isolation_draw = kernel_draw(state0, first);
+        int32_t death_draw = kernel_draw(state0, first + (uint64_t)(isolates & 1));
+        double death_chance = death_by_age[MIN((uint32_t)row[k].age, 3u)] - p.vaccine_protection * row[k].vaccinated;
+        int32_t s = kernel_blend(isolates & -((isolation_draw % 100) < p.isolation_chance), ISOLATED_YELLOW, status[k]);
+        status[k] = kernel_blend(resolves, kernel_blend(-((death_draw % 100) < death_chance), DEAD_BLACK, CURED_GREEN), s);
+    }
+
+    memcpy(out, row, (size_t)len * sizeof(Cell));
+    for (int k = 0; k < len; k++)
+    {
+        out[k].status = (CellStatus)status[k];
+        out[k].contagion_t = contagion_t[k];
+    }
+}
+
+/*
+    Counts the contagious neighbors of a whole chunk of the row first, with
+    plain loops over contiguous cells the compiler can vectorize, then runs
+    the rules, cell by cell or with kernel_rules() in a BRANCHLESS=t build.
+    `vertical[k]` holds the contagious cells of column c0 + k - 1.
+*/
+static inline __attribute__((always_inline)) void kernel_chunked(Cell *above, Cell *row, Cell *below, Cell *out,
+                                                                 int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    int32_t vertical[KERNEL_CHUNK + 2];
+    int32_t inf_n[KERNEL_CHUNK];
+    for (int c0 = 0; c0 < cols; c0 += KERNEL_CHUNK)
+    {
+        int len = MIN(KERNEL_CHUNK, cols - c0);
+        int left = (c0 - 1 + cols) % cols;
+        int right = (c0 + len) % cols;
+        vertical[0] = (above[left].status == SICK_C_RED) + (row[left].status == SICK_C_RED) + (below[left].status == SICK_C_RED);
+        vertical[len + 1] = (above[right].status == SICK_C_RED) + (row[right].status == SICK_C_RED) + (below[right].status == SICK_C_RED);
+        for (int k = 0; k < len; k++)
+            vertical[k + 1] = (above[c0 + k].status == SICK_C_RED) +
+                              (row[c0 + k].status == SICK_C_RED) +
+                              (below[c0 + k].status == SICK_C_RED);
+        for (int k = 0; k < len; k++)
+            inf_n[k] = vertical[k] + vertical[k + 1] + vertical[k + 2] - (row[c0 + k].status == SICK_C_RED);
+
+#if defined(BRANCHLESS_RULES) && BRANCHLESS_RULES
+        kernel_rules(&row[c0], &out[c0], inf_n, len, time, seed, cell_base + (uint64_t)c0);
+#else
+        for (int k = 0; k < len; k++)
+        {
+            out[c0 + k] = row[c0 + k];
+            CellRng rng;
+            cell_rng_seed(&rng, seed, time, cell_base + (uint64_t)(c0 + k));
+            apply_rules(&out[c0 + k], inf_n[k], time, &rng);
+        }
+#endif
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ENGINE_X86 1
+#else
+#define ENGINE_X86 0
+#endif
+
+#if defined(SPEC_KERNEL) && SPEC_KERNEL
+#include "kernel_gen.h"
+#include "kernel_spec.h"
+#define KERNEL_SPEC_FN kernel_specialized
+#else
+#define KERNEL_SPEC_FN NULL
+#endif
+
+#if ENGINE_X86
+__attribute__((target("sse4.2"))) void kernel_sse42(Cell *above, Cell *row, Cell *below, Cell *out,
+                                                    int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    kernel_chunked(above, row, below, out, cols, time, seed, cell_base);
+}
+
+__attribute__((target("avx2"))) void kernel_avx2(Cell *above, Cell *row, Cell *below, Cell *out,
+                                                 int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    kernel_chunked(above, row, below, out, cols, time, seed, cell_base);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void kernel_avx512(Cell *above, Cell *row, Cell *below, Cell *out,
+                                                               int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    kernel_chunked(above, row, below, out, cols, time, seed, cell_base);
+}
+
+RowKernel kernel_table[KERNEL_KINDS] = {kernel_scalar, kernel_sse42, kernel_avx2, kernel_avx512, KERNEL_SPEC_FN};
+#else
+RowKernel kernel_table[KERNEL_KINDS] = {kernel_scalar, NULL, NULL, NULL, KERNEL_SPEC_FN};
+#endif
+
+bool kernel_supported(KernelKind kind)
+{
+    if (kind == KERNEL_SPECIALIZED)
+        return kernel_table[KERNEL_SPECIALIZED] != NULL;
+#if ENGINE_X86
+    __builtin_cpu_init();
+    switch (kind)
+    {
+    case KERNEL_SCALAR:
+        return true;
+    case KERNEL_SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case KERNEL_AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    case KERNEL_SPECIALIZED:
+    case KERNEL_KINDS:
+    default:
+        return false;
+    }
+#else
+    return kind == KERNEL_SCALAR;
+#endif
+}
+
+// Whether `kind` computes the step of a grid `cols` wide with rule_params
+bool kernel_matches(KernelKind kind, int cols)
+{
+#if defined(SPEC_KERNEL) && SPEC_KERNEL
+    if (kind == KERNEL_SPECIALIZED)
+        return cols == SPEC_COLS && rules_equal(&rule_params, &spec_rules);
+#endif
+    (void)cols;
+    return kind != KERNEL_SPECIALIZED;
+}
+
+// Points the specialized kernel at its widest variant this CPU supports
+void kernel_specialize_isa(void)
+{
+#if defined(SPEC_KERNEL) && SPEC_KERNEL && ENGINE_X86
+    if (kernel_supported(KERNEL_AVX512))
+        kernel_table[KERNEL_SPECIALIZED] = kernel_specialized_avx512;
+    else if (kernel_supported(KERNEL_AVX2))
+        kernel_table[KERNEL_SPECIALIZED] = kernel_specialized_avx2;
+    else if (kernel_supported(KERNEL_SSE42))
+        kernel_table[KERNEL_SPECIALIZED] = kernel_specialized_sse42;
+#endif
+}
+
+/*
+    Picks the kernel called `name`, or when `name` is NULL or "auto" the
+    specialized kernel if it matches the grid width and rules, else the
+    fastest one the CPU supports. `cols` is 0 when the kernel runs on
+    windows of the rows (--tiles, curve layouts), which the specialized
+    kernel can't. Returns -1 if the kernel is unknown, can't run on this
+    CPU or wasn't built for this grid.
+*/
+int kernel_select(const char *name, int cols, KernelKind *kind)
+{
+    assert(kind != NULL);
+    if (name == NULL || strcmp(name, "auto") == 0)
+    {
+        for (int k = KERNEL_KINDS - 1; k >= 0; k--)
+        {
+            if (kernel_supported((KernelKind)k) && kernel_matches((KernelKind)k, cols))
+            {
+                *kind = (KernelKind)k;
+                kernel_specialize_isa();
+                return 0;
+            }
+        }
+    }
+    for (int k = 0; k < KERNEL_KINDS; k++)
+    {
+        if (name != NULL && strcmp(name, kernel_names[k]) == 0)
+        {
+            if (!kernel_supported((KernelKind)k))
+            {
+                fprintf(stderr, "[ERR] Kernel '%s' is not supported by this %s\n", name,
+                        k == KERNEL_SPECIALIZED ? "build (make SPEC=t)" : "CPU");
+                return -1;
+            }
+            if (!kernel_matches((KernelKind)k, cols))
+            {
+                if (cols == 0)
+                    fprintf(stderr, "[ERR] Kernel '%s' only runs on whole rows, not with --tiles or --layout\n", name);
+                else
+                    fprintf(stderr, "[ERR] Kernel '%s' was built for other columns or rules\n", name);
+                return -1;
+            }
+            *kind = (KernelKind)k;
+            kernel_specialize_isa();
+            return 0;
+        }
+    }
+    fprintf(stderr, "[ERR] Unknown kernel '%s' (scalar, sse4.2, avx2, avx512, specialized or auto)\n", name);
+    return -1;
+}
+
+/*
+    Global index of the first cell of global row `row` of a grid `w` wide,
+    the `cell_base` of its kernel call. Grids past 2^31 cells need all 64
+    bits of it.
+*/
+uint64_t engine_cell_base(long row, int w)
+{
+    assert(row >= 0 && w > 0);
+    return (uint64_t)row * (uint64_t)w;
+}
+
+/*
+    Updates row `i` of the `w` x `h` grid `matrix` into `upd_matrix`, rows
+    wrap around. `row_offset` is the global index of the first row of
+    `matrix`, which differs from 0 for the slabs of the MPI backends.
+*/
+void engine_update_row(RowKernel kernel, Cell *matrix, Cell *upd_matrix, int w, int h, int i,
+                       int time, uint64_t seed, long row_offset)
+{
+    Cell *above = &matrix[(size_t)((i - 1 + h) % h) * (size_t)w];
+    Cell *row = &matrix[(size_t)i * (size_t)w];
+    Cell *below = &matrix[(size_t)((i + 1) % h) * (size_t)w];
+    kernel(above, row, below, &upd_matrix[(size_t)i * (size_t)w], w, time, seed, engine_cell_base(row_offset + i, w));
+}
+
+/*
+    Updates rows [first, last) of `matrix` in place. `above` and `below`
+    hold the previous state of rows first - 1 and last. Each row is computed
+    into `ring` (2 rows) and copied back one row later, once the row below it
+    has read it, so the result is the same as with a second grid.
+*/
+void engine_update_rows_inplace(RowKernel kernel, Cell *matrix, int w, int first, int last,
+                                Cell *above, Cell *below, Cell *ring, int time, uint64_t seed, long row_offset)
+{
+    size_t row_bytes = (size_t)w * sizeof(Cell);
+    for (int i = first; i < last; i++)
+    {
+        Cell *up = i == first ? above : &matrix[(size_t)(i - 1) * (size_t)w];
+        Cell *down = i == last - 1 ? below : &matrix[(size_t)(i + 1) * (size_t)w];
+        kernel(up, &matrix[(size_t)i * (size_t)w], down, &ring[(size_t)(i % 2) * (size_t)w], w, time, seed,
+               engine_cell_base(row_offset + i, w));
+        if (i > first)
+            memcpy(&matrix[(size_t)(i - 1) * (size_t)w], &ring[(size_t)((i - 1) % 2) * (size_t)w], row_bytes);
+    }
+    if (last > first)
+        memcpy(&matrix[(size_t)(last - 1) * (size_t)w], &ring[(size_t)((last - 1) % 2) * (size_t)w], row_bytes);
+}
+
+#ifdef _OPENMP
+/*
+    engine_update_rows_inplace() over rows [first, last) of the `w` x `h`
+    grid `matrix` (rows wrap around), one chunk per thread of the current
+    team. Every thread must call it. Threads first copy the rows bordering
+    their chunk, which their neighbors are about to overwrite, into
+    `scratch` (4 rows per thread).
+*/
+void engine_update_team_inplace(RowKernel kernel, Cell *matrix, int w, int h, int first, int last,
+                                Cell *scratch, int time, uint64_t seed, long row_offset)
+{
+    int n_threads = omp_get_num_threads();
+    int tid = omp_get_thread_num();
+    int n = last - first;
+    int chunk_first = first + (int)((long)n * tid / n_threads);
+    int chunk_last = first + (int)((long)n * (tid + 1) / n_threads);
+    Cell *above = &scratch[(size_t)tid * 4 * (size_t)w];
+    Cell *below = &above[w];
+    Cell *ring = &above[2 * w];
+    if (chunk_first < chunk_last)
+    {
+        memcpy(above, &matrix[(size_t)((chunk_first - 1 + h) % h) * (size_t)w], (size_t)w * sizeof(Cell));
+        memcpy(below, &matrix[(size_t)(chunk_last % h) * (size_t)w], (size_t)w * sizeof(Cell));
+    }
+#pragma omp barrier
+    engine_update_rows_inplace(kernel, matrix, w, chunk_first, chunk_last, above, below, ring, time, seed, row_offset);
+}
+
+// Steps done by the band of one thread, alone on its cache line
+typedef struct BandClock
+{
+    int done;
+    char pad[64 - sizeof(int)];
+} BandClock;
+
+/*
+    Runs `steps` steps of the `w` x `h` grid in `grids[0]`, double buffered
+    with `grids[1]`, with no barrier between steps: every thread of the
+    current team owns a fixed band of rows and only waits for the bands
+    above and below its own to finish the previous step, whose rows it
+    reads and whose reads it would overwrite. A thread can't get more than
+    one step ahead of its neighbors, but a slow band only holds back the
+    bands around it. `clocks` holds one zeroed clock per thread. Every
+    thread must call it, the grid is in grids[steps % 2] once they return.
+*/
+void engine_update_team_bands(RowKernel kernel, Cell *grids[2], int w, int h, int steps, BandClock *clocks,
+                              uint64_t seed)
+{
+    int n_bands = omp_get_num_threads();
+    int band = omp_get_thread_num();
+    int up = (band - 1 + n_bands) % n_bands;
+    int down = (band + 1) % n_bands;
+    int first = (int)((long)h * band / n_bands);
+    int last = (int)((long)h * (band + 1) / n_bands);
+    assert(h >= n_bands);
+    for (int t = 0; t < steps; t++)
+    {
+        while (__atomic_load_n(&clocks[up].done, __ATOMIC_ACQUIRE) < t ||
+               __atomic_load_n(&clocks[down].done, __ATOMIC_ACQUIRE) < t)
+            sched_yield();
+        for (int i = first; i < last; i++)
+            engine_update_row(kernel, grids[t % 2], grids[(t + 1) % 2], w, h, i, t, seed, 0);
+        __atomic_store_n(&clocks[band].done, t + 1, __ATOMIC_RELEASE);
+    }
+}
+#endif
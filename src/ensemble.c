@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <mpi.h>
+#include <omp.h>
+
+#define MASTER_RANK 0
+
+#include "utils.h"
+#include "simulation.h"
+#include "options.h"
+#include "trace.h"
+#include "engine.h"
+#include "raster.h"
+#include "mobility.h"
+
+/*
+    Adaptive ensemble driver: runs replicas of several scenarios until
+    their estimates converge, instead of a fixed number of seeds each.
+
+    The scenario file holds one scenario per line, the command line of a
+    backend without the program name ("<rows> <cols> f [options]"), blank
+    and '#' lines skipped. Replica k of a scenario runs it with seed
+    --seed + k, whole on one thread, so replicas give the same results as
+    build/main with that seed.
+
+    Replicas run in waves: each wave, the master hands every rank a batch
+    of --batch replicas (one per thread by default) of one scenario still
+    running, rotating through them, and the ranks send back the peak of
+    sick cells, the step of that peak and the final dead count of each
+    replica. A scenario stops once it has --min replicas and the
+    confidence interval of every estimate is within --precision of its
+    mean (or of 1 cell or step when the mean is smaller), or after --max
+    replicas. Its workers go to the other scenarios from the next wave on.
+    How many replicas a scenario gets depends on the wave sizes, each
+    replica's result does not.
+
+    The rules are global (see simulation.h), so the threads of a rank only
+    ever run replicas of one scenario at a time.
+*/
+
+#define ENSEMBLE_USAGE "Usage: %s <scenarios> [--precision=P] [--confidence=C] [--min=N] [--max=N] [--batch=N]\n"
+#define ENSEMBLE_LINE 4096
+#define ENSEMBLE_ARGS 64
+#define METRICS 3
+
+const char *metric_names[METRICS] = {"peak_sick", "peak_step", "dead"};
+
+typedef struct Scenario
+{
+    char line[ENSEMBLE_LINE]; // As written in the file
+    char *args;               // Split copy of `line`, `opts` points into it, so it stays put when the array grows
+    Options opts;
+    RuleParams rules;
+    RowKernel kernel;
+    int next;  // Master: first replica not handed out yet
+    int done;  // Master: replicas folded into the sums
+    double sum[METRICS];
+    double sum_sq[METRICS]; // Exact for integer metrics, whatever the order replicas come back in
+    bool converged;
+} Scenario;
+
+typedef struct Ensemble
+{
+    double precision; // Half width of the intervals, relative to the means
+    double z;         // Of the confidence level
+    int min_replicas;
+    int max_replicas;
+    int batch; // Replicas per rank and wave
+    int n_scenarios;
+    Scenario *scenarios;
+} Ensemble;
+
+// Normal quantile z such that a fraction `confidence` of the draws lie within +-z
+double confidence_z(double confidence)
+{
+    double lo = 0;
+    double hi = 40;
+    for (int k = 0; k < 100; k++)
+    {
+        double mid = (lo + hi) / 2;
+        if (erf(mid / sqrt(2.0)) < confidence)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+// Parses a scenario line, errors are printed unless `quiet`. Returns -1 on error.
+int scenario_parse(Scenario *sc, bool quiet)
+{
+    char const *argv[ENSEMBLE_ARGS];
+    sc->args = malloc(strlen(sc->line) + 1);
+    if (sc->args == NULL)
+        return -1;
+    strcpy(sc->args, sc->line);
+    int argc = split_command_line(sc->args, "ensemble", argv, ENSEMBLE_ARGS);
+    if (parse_options(argc, argv, &sc->opts, quiet) != 0)
+        return -1;
+    const Options *opts = &sc->opts;
+    if (opts->use_gui || opts->rolling || opts->tile_size > 0 || opts->graph_path != NULL || opts->trace_path != NULL ||
+        opts->dump_path != NULL || opts->sync_neighbors || opts->telemetry != NULL ||
+        (opts->layout != NULL && strcmp(opts->layout, "rows") != 0))
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] Replicas run double buffered and row-major, without the GUI, --tiles, --graph, "
+                            "--trace, --dump, --sync or --telemetry\n");
+        return -1;
+    }
+    sc->rules = (RuleParams)RULES_DEFAULT;
+    if (opts->rules_path != NULL && load_rules(opts->rules_path, &sc->rules) != 0)
+        return -1;
+    rule_params = sc->rules;
+    if (mobility_enabled())
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] Replicas don't run the mobility rules\n");
+        return -1;
+    }
+    KernelKind kernel_kind;
+    if (kernel_select(opts->kernel, opts->cols, &kernel_kind) != 0)
+        return -1;
+    sc->kernel = kernel_table[kernel_kind];
+    sc->next = 0;
+    sc->done = 0;
+    for (int m = 0; m < METRICS; m++)
+    {
+        sc->sum[m] = 0;
+        sc->sum_sq[m] = 0;
+    }
+    sc->converged = false;
+    return 0;
+}
+
+// Reads the scenarios of the file at `path`. Returns -1 on error.
+int scenarios_load(Ensemble *ens, const char *path, bool quiet)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] Can't open scenario file '%s'\n", path);
+        return -1;
+    }
+    int capacity = 16;
+    ens->n_scenarios = 0;
+    ens->scenarios = malloc((size_t)capacity * sizeof(Scenario));
+    char line[ENSEMBLE_LINE];
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[strspn(line, " \t")] == '\0' || line[strspn(line, " \t")] == '#')
+            continue;
+        if (ens->n_scenarios == capacity)
+        {
+            capacity *= 2;
+            ens->scenarios = realloc(ens->scenarios, (size_t)capacity * sizeof(Scenario));
+        }
+        Scenario *sc = &ens->scenarios[ens->n_scenarios];
+        strcpy(sc->line, line);
+        if (scenario_parse(sc, quiet) != 0)
+        {
+            if (!quiet)
+                fprintf(stderr, "[ERR] Bad scenario '%s'\n", line);
+            fclose(f);
+            return -1;
+        }
+        ens->n_scenarios++;
+    }
+    fclose(f);
+    if (ens->n_scenarios == 0)
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] No scenario in '%s'\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    Runs replica `replica` of `sc` on the calling thread, rule_params must
+    hold its rules. Writes its metrics to `metrics`. Returns -1 on error.
+*/
+int replica_run(const Scenario *sc, int replica, double *metrics)
+{
+    int rows = sc->opts.rows;
+    int cols = sc->opts.cols;
+    size_t n_cells = (size_t)rows * (size_t)cols;
+    Cell *matrix = malloc(n_cells * sizeof(Cell));
+    Cell *upd_matrix = malloc(n_cells * sizeof(Cell));
+    unsigned int seed = sc->opts.seed + (unsigned int)replica;
+    int result = 0;
+    if (matrix == NULL || upd_matrix == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't allocate a %dx%d grid\n", rows, cols);
+        result = -1;
+    }
+    else if (sc->opts.population_path == NULL)
+    {
+        // rand() is one stream for the whole process
+#pragma omp critical(replica_init)
+        {
+            srand(seed);
+            init_cell_matrix(matrix, cols, rows);
+        }
+    }
+    else
+        result = raster_load_rows(sc->opts.population_path, matrix, rows, cols, 0, rows);
+
+    long peak = -1;
+    int peak_step = 0;
+    for (int sim_t = 0; result == 0; sim_t++)
+    {
+        long sick = 0;
+        for (size_t k = 0; k < n_cells; k++)
+            sick += is_sick(matrix[k]);
+        if (sick > peak)
+        {
+            peak = sick;
+            peak_step = sim_t;
+        }
+        if (sim_t == sc->opts.steps)
+            break;
+        for (int i = 0; i < rows; i++)
+            engine_update_row(sc->kernel, matrix, upd_matrix, cols, rows, i, sim_t, seed, 0);
+        Cell *temp = matrix;
+        matrix = upd_matrix;
+        upd_matrix = temp;
+    }
+    if (result == 0)
+    {
+        long dead = 0;
+        for (size_t k = 0; k < n_cells; k++)
+            dead += matrix[k].status == DEAD_BLACK;
+        metrics[0] = (double)peak;
+        metrics[1] = (double)peak_step;
+        metrics[2] = (double)dead;
+    }
+    free(matrix);
+    free(upd_matrix);
+    return result;
+}
+
+// Mean and confidence half width of metric `m` of `sc`
+void scenario_estimate(const Ensemble *ens, const Scenario *sc, int m, double *mean, double *half)
+{
+    double n = (double)sc->done;
+    *mean = sc->sum[m] / MAX(n, 1);
+    *half = 0;
+    if (sc->done > 1)
+    {
+        double var = MAX((sc->sum_sq[m] - sc->sum[m] * *mean) / (n - 1), 0);
+        *half = ens->z * sqrt(var / n);
+    }
+}
+
+bool scenario_converged(const Ensemble *ens, const Scenario *sc)
+{
+    if (sc->done < ens->min_replicas)
+        return false;
+    for (int m = 0; m < METRICS; m++)
+    {
+        double mean, half;
+        scenario_estimate(ens, sc, m, &mean, &half);
+        if (half > ens->precision * MAX(fabs(mean), 1))
+            return false;
+    }
+    return true;
+}
+
+/*
+    Master: fills `plan` with the (scenario, first replica, count) of each
+    of `nprocs` ranks for the next wave, starting the rotation at `turn`.
+    Returns the number of replicas handed out, 0 once every scenario is over.
+*/
+int ensemble_plan(Ensemble *ens, int *plan, int nprocs, int turn)
+{
+    int *running = malloc((size_t)ens->n_scenarios * sizeof(int));
+    int n_running = 0;
+    for (int s = 0; s < ens->n_scenarios; s++)
+    {
+        if (!ens->scenarios[s].converged && ens->scenarios[s].next < ens->max_replicas)
+            running[n_running++] = s;
+    }
+    int handed = 0;
+    for (int r = 0; r < nprocs; r++)
+    {
+        plan[3 * r] = 0;
+        plan[3 * r + 1] = 0;
+        plan[3 * r + 2] = 0;
+        if (n_running == 0)
+            continue;
+        Scenario *sc = &ens->scenarios[running[(turn + r) % n_running]];
+        int count = MIN(ens->batch, ens->max_replicas - sc->next);
+        plan[3 * r] = running[(turn + r) % n_running];
+        plan[3 * r + 1] = sc->next;
+        plan[3 * r + 2] = count;
+        sc->next += count;
+        handed += count;
+    }
+    free(running);
+    return handed;
+}
+
+// Master: prints the estimates of every scenario
+void ensemble_report(const Ensemble *ens)
+{
+    for (int s = 0; s < ens->n_scenarios; s++)
+        printf("# %d: %s\n", s, ens->scenarios[s].line);
+    printf("# scenario replicas converged");
+    for (int m = 0; m < METRICS; m++)
+        printf(" %s %s_ci", metric_names[m], metric_names[m]);
+    printf("\n");
+    for (int s = 0; s < ens->n_scenarios; s++)
+    {
+        const Scenario *sc = &ens->scenarios[s];
+        printf("%d %d %s", s, sc->done, sc->converged ? "yes" : "no");
+        for (int m = 0; m < METRICS; m++)
+        {
+            double mean, half;
+            scenario_estimate(ens, sc, m, &mean, &half);
+            printf(" %.3f %.3f", mean, half);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    int nprocs, rank;
+    MPI_Init(NULL, NULL);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    bool quiet = rank != MASTER_RANK;
+
+    if (argc < 2)
+    {
+        if (!quiet)
+            fprintf(stderr, ENSEMBLE_USAGE, argv[0]);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    Ensemble ens = {.precision = 0.05, .z = confidence_z(0.95), .min_replicas = 10, .max_replicas = 500,
+                    .batch = omp_get_max_threads()};
+    for (int k = 2; k < argc; k++)
+    {
+        const char *arg = argv[k];
+        if (starts_with(arg, "--precision="))
+            ens.precision = atof(arg + strlen("--precision="));
+        else if (starts_with(arg, "--confidence="))
+            ens.z = confidence_z(atof(arg + strlen("--confidence=")));
+        else if (starts_with(arg, "--min="))
+            ens.min_replicas = MAX(atoi(arg + strlen("--min=")), 2);
+        else if (starts_with(arg, "--max="))
+            ens.max_replicas = atoi(arg + strlen("--max="));
+        else if (starts_with(arg, "--batch="))
+            ens.batch = MAX(atoi(arg + strlen("--batch=")), 1);
+        else
+        {
+            if (!quiet)
+                fprintf(stderr, "[ERR] Unknown option '%s'\n" ENSEMBLE_USAGE, arg, argv[0]);
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+    }
+    ens.max_replicas = MAX(ens.max_replicas, ens.min_replicas);
+    if (scenarios_load(&ens, argv[1], quiet) != 0)
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    // Scenarios without --seed draw it from the clock, every rank must use the master's
+    for (int s = 0; s < ens.n_scenarios; s++)
+        MPI_Bcast(&ens.scenarios[s].opts.seed, 1, MPI_UNSIGNED, MASTER_RANK, MPI_COMM_WORLD);
+
+    int *plan = malloc((size_t)nprocs * 3 * sizeof(int));
+    size_t batch_values = (size_t)ens.batch * METRICS;
+    double *metrics = calloc(batch_values, sizeof(double));
+    double *all_metrics = rank == MASTER_RANK ? malloc((size_t)nprocs * batch_values * sizeof(double)) : NULL;
+    int waves = 0;
+    for (int turn = 0;; turn += nprocs)
+    {
+        int handed = 0;
+        if (rank == MASTER_RANK)
+            handed = ensemble_plan(&ens, plan, nprocs, turn);
+        MPI_Bcast(&handed, 1, MPI_INT, MASTER_RANK, MPI_COMM_WORLD);
+        if (handed == 0)
+            break;
+        MPI_Bcast(plan, nprocs * 3, MPI_INT, MASTER_RANK, MPI_COMM_WORLD);
+
+        const Scenario *sc = &ens.scenarios[plan[3 * rank]];
+        int first = plan[3 * rank + 1];
+        int count = plan[3 * rank + 2];
+        int failed = 0;
+        rule_params = sc->rules;
+#pragma omp parallel for schedule(dynamic) reduction(+ : failed)
+        for (int k = 0; k < count; k++)
+            failed += replica_run(sc, first + k, &metrics[k * METRICS]) != 0;
+        MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        if (failed > 0)
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        MPI_Gather(metrics, (int)batch_values, MPI_DOUBLE, all_metrics, (int)batch_values, MPI_DOUBLE, MASTER_RANK,
+                   MPI_COMM_WORLD);
+
+        if (rank == MASTER_RANK)
+        {
+            for (int r = 0; r < nprocs; r++)
+            {
+                Scenario *done = &ens.scenarios[plan[3 * r]];
+                for (int k = 0; k < plan[3 * r + 2]; k++)
+                {
+                    for (int m = 0; m < METRICS; m++)
+                    {
+                        double x = all_metrics[(size_t)r * batch_values + (size_t)k * METRICS + (size_t)m];
+                        done->sum[m] += x;
+                        done->sum_sq[m] += x * x;
+                    }
+                    done->done++;
+                }
+            }
+            for (int s = 0; s < ens.n_scenarios; s++)
+            {
+                Scenario *scenario = &ens.scenarios[s];
+                if (!scenario->converged && scenario_converged(&ens, scenario))
+                {
+                    scenario->converged = true;
+                    DEBUG_PRINT("Scenario %d converged after %d replicas\n", s, scenario->done);
+                }
+            }
+        }
+        waves++;
+    }
+
+    if (rank == MASTER_RANK)
+    {
+        DEBUG_PRINT("%d waves on %d ranks of %d threads\n", waves, nprocs, omp_get_max_threads());
+        ensemble_report(&ens);
+    }
+    free(plan);
+    free(metrics);
+    free(all_metrics);
+    for (int s = 0; s < ens.n_scenarios; s++)
+        free(ens.scenarios[s].args);
+    free(ens.scenarios);
+    MPI_Finalize();
+    return 0;
+}
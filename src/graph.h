@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Contact graph engine (--graph=FILE): the 8 neighbors of the grid are
+    replaced by the neighbor lists of a graph with one vertex per cell, so
+    households, workplaces or any other structure decide who meets whom.
+    The rules are unchanged: a susceptible cell counts its contagious
+    neighbors, and draws from (seed, time, cell) as on the grid, so the
+    graph of the torus Moore neighborhood (build/mkgraph without options)
+    gives exactly the grid engines' result.
+
+    The graph is stored in CSR form (offsets into one array of neighbors).
+    Once loaded it is renumbered in reverse Cuthill-McKee order, so
+    vertices that meet end up close in memory. Threads and ranks get
+    contiguous ranges of vertices, which then cut few edges. Cells are
+    stored in vertex order, `order` maps them back to the grid.
+
+    File: the magic "COVIDGRF", rows and cols (uint32) and the number of
+    neighbor entries (uint64), then rows * cols + 1 uint64 offsets and the
+    uint32 neighbors (cell indices), all little endian.
+*/
+
+#define GRAPH_MAGIC "COVIDGRF"
+#define GRAPH_HEADER 24
+
+typedef struct Graph
+{
+    uint32_t n;         // Vertices
+    uint64_t *offsets;  // n + 1, neighbors of vertex k are edges[offsets[k]..offsets[k + 1])
+    uint32_t *edges;
+    uint32_t *order;    // Cell of each vertex
+} Graph;
+
+void graph_free(Graph *graph)
+{
+    free(graph->offsets);
+    free(graph->edges);
+    free(graph->order);
+}
+
+// Largest distance between the indices of two neighbors
+uint32_t graph_bandwidth(const Graph *graph)
+{
+    uint32_t bandwidth = 0;
+    for (uint32_t k = 0; k < graph->n; k++)
+    {
+        for (uint64_t e = graph->offsets[k]; e < graph->offsets[k + 1]; e++)
+            bandwidth = MAX(bandwidth, graph->edges[e] > k ? graph->edges[e] - k : k - graph->edges[e]);
+    }
+    return bandwidth;
+}
+
+static int graph_key_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+    Reverse Cuthill-McKee: breadth-first from a vertex of lowest degree,
+    neighbors by increasing degree, the visit order reversed. Each
+    connected component starts from its lowest degree vertex. Fills
+    `order` with the vertices in their new order.
+*/
+static void graph_rcm(const Graph *graph, uint32_t *order)
+{
+    uint32_t n = graph->n;
+    // (degree, vertex) keys, sorted: start vertices and neighbor order
+    uint64_t *by_degree = malloc((size_t)n * sizeof(uint64_t));
+    uint64_t max_degree = 0;
+    for (uint32_t k = 0; k < n; k++)
+    {
+        uint64_t degree = graph->offsets[k + 1] - graph->offsets[k];
+        max_degree = MAX(max_degree, degree);
+        by_degree[k] = degree << 32 | k;
+    }
+    qsort(by_degree, n, sizeof(uint64_t), graph_key_cmp);
+    uint64_t *keys = malloc((size_t)(max_degree + 1) * sizeof(uint64_t));
+    bool *visited = calloc(n, sizeof(bool));
+
+    uint32_t tail = 0;
+    for (uint32_t s = 0; s < n; s++)
+    {
+        uint32_t start = (uint32_t)by_degree[s];
+        if (visited[start])
+            continue;
+        visited[start] = true;
+        order[tail++] = start;
+        for (uint32_t head = tail - 1; head < tail; head++)
+        {
+            uint32_t u = order[head];
+            size_t n_keys = 0;
+            for (uint64_t e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
+            {
+                uint32_t v = graph->edges[e];
+                if (visited[v])
+                    continue;
+                visited[v] = true;
+                keys[n_keys++] = (graph->offsets[v + 1] - graph->offsets[v]) << 32 | v;
+            }
+            qsort(keys, n_keys, sizeof(uint64_t), graph_key_cmp);
+            for (size_t k = 0; k < n_keys; k++)
+                order[tail++] = (uint32_t)keys[k];
+        }
+    }
+    for (uint32_t k = 0; k < n / 2; k++)
+    {
+        uint32_t temp = order[k];
+        order[k] = order[n - 1 - k];
+        order[n - 1 - k] = temp;
+    }
+    free(by_degree);
+    free(keys);
+    free(visited);
+}
+
+static int graph_neighbor_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// `out` gets `graph` renumbered in RCM order
+static void graph_renumber(const Graph *graph, Graph *out)
+{
+    uint32_t n = graph->n;
+    uint32_t *rcm = malloc((size_t)n * sizeof(uint32_t));
+    graph_rcm(graph, rcm);
+    uint32_t *position = malloc((size_t)n * sizeof(uint32_t));
+    for (uint32_t k = 0; k < n; k++)
+        position[rcm[k]] = k;
+
+    out->n = n;
+    out->offsets = malloc(((size_t)n + 1) * sizeof(uint64_t));
+    out->edges = malloc((size_t)MAX(graph->offsets[n], 1) * sizeof(uint32_t));
+    out->order = malloc((size_t)n * sizeof(uint32_t));
+    out->offsets[0] = 0;
+    for (uint32_t k = 0; k < n; k++)
+    {
+        uint32_t u = rcm[k];
+        uint64_t degree = graph->offsets[u + 1] - graph->offsets[u];
+        for (uint64_t e = 0; e < degree; e++)
+            out->edges[out->offsets[k] + e] = position[graph->edges[graph->offsets[u] + e]];
+        // Neighbors read in memory order
+        qsort(&out->edges[out->offsets[k]], degree, sizeof(uint32_t), graph_neighbor_cmp);
+        out->offsets[k + 1] = out->offsets[k] + degree;
+        out->order[k] = graph->order[u];
+    }
+    free(rcm);
+    free(position);
+}
+
+/*
+    Splits the vertices in `parts` contiguous ranges of about the same
+    work (a vertex and its neighbors): part p gets [bounds[p], bounds[p + 1]).
+    With more parts than vertices, the parts past the n-th are empty.
+*/
+void graph_partition(const Graph *graph, int parts, uint32_t *bounds)
+{
+    uint64_t total = graph->offsets[graph->n] + graph->n;
+    int filled = (int)MIN((uint32_t)parts, graph->n);
+    uint32_t k = 0;
+    bounds[0] = 0;
+    for (int p = 1; p < filled; p++)
+    {
+        uint64_t target = total * (uint64_t)p / (uint64_t)filled;
+        // Leave at least one vertex to every filled part
+        while (k < graph->n - (uint32_t)(filled - p) && graph->offsets[k] + k < target)
+            k++;
+        bounds[p] = MAX(k, bounds[p - 1] + 1);
+    }
+    for (int p = MAX(filled, 1); p <= parts; p++)
+        bounds[p] = graph->n;
+}
+
+// Neighbor entries crossing the ranges of graph_partition()
+uint64_t graph_edge_cut(const Graph *graph, int parts, const uint32_t *bounds)
+{
+    uint64_t cut = 0;
+    for (int p = 0; p < parts; p++)
+    {
+        for (uint32_t k = bounds[p]; k < bounds[p + 1]; k++)
+        {
+            for (uint64_t e = graph->offsets[k]; e < graph->offsets[k + 1]; e++)
+                cut += graph->edges[e] < bounds[p] || graph->edges[e] >= bounds[p + 1];
+        }
+    }
+    return cut;
+}
+
+static uint64_t graph_read_le(const uint8_t *bytes, int n_bytes)
+{
+    uint64_t value = 0;
+    for (int b = n_bytes - 1; b >= 0; b--)
+        value = value << 8 | bytes[b];
+    return value;
+}
+
+/*
+    Loads the graph at `path`, it must have one vertex per cell of a `rows`
+    x `cols` grid, to be split in `parts` ranges. The vertices are
+    renumbered in RCM order unless the file order cuts fewer edges between
+    the ranges (a torus split in row blocks does). Returns -1 on error.
+*/
+int graph_load(Graph *graph, const char *path, int rows, int cols, int parts)
+{
+    assert(graph != NULL && path != NULL);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't open contact graph '%s'\n", path);
+        return -1;
+    }
+    uint8_t header[GRAPH_HEADER];
+    if (fread(header, 1, GRAPH_HEADER, f) != GRAPH_HEADER || memcmp(header, GRAPH_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "[ERR] '%s' is not a contact graph\n", path);
+        fclose(f);
+        return -1;
+    }
+    uint64_t graph_rows = graph_read_le(&header[8], 4);
+    uint64_t graph_cols = graph_read_le(&header[12], 4);
+    uint64_t n_edges = graph_read_le(&header[16], 8);
+    if (graph_rows != (uint64_t)rows || graph_cols != (uint64_t)cols)
+    {
+        fprintf(stderr, "[ERR] '%s' is a graph of %llux%llu cells, expected %dx%d\n", path,
+                (unsigned long long)graph_rows, (unsigned long long)graph_cols, rows, cols);
+        fclose(f);
+        return -1;
+    }
+    // Vertices are 32-bit, like the neighbor entries
+    if (graph_rows * graph_cols > UINT32_MAX)
+    {
+        fprintf(stderr, "[ERR] '%s' has more than %u vertices\n", path, UINT32_MAX);
+        fclose(f);
+        return -1;
+    }
+
+    graph->n = (uint32_t)(graph_rows * graph_cols);
+    graph->offsets = malloc(((size_t)graph->n + 1) * sizeof(uint64_t));
+    graph->edges = malloc((size_t)MAX(n_edges, 1) * sizeof(uint32_t));
+    graph->order = NULL;
+    // Read in bulk, then decoded in place
+    bool valid = fread(graph->offsets, sizeof(uint64_t), (size_t)graph->n + 1, f) == (size_t)graph->n + 1 &&
+                 fread(graph->edges, sizeof(uint32_t), (size_t)n_edges, f) == (size_t)n_edges;
+    for (uint32_t k = 0; k <= graph->n && valid; k++)
+    {
+        graph->offsets[k] = graph_read_le((const uint8_t *)&graph->offsets[k], 8);
+        valid = graph->offsets[k] <= n_edges && (k == 0 ? graph->offsets[k] == 0 : graph->offsets[k] >= graph->offsets[k - 1]);
+    }
+    valid = valid && graph->offsets[graph->n] == n_edges;
+    for (uint64_t e = 0; e < n_edges && valid; e++)
+    {
+        graph->edges[e] = (uint32_t)graph_read_le((const uint8_t *)&graph->edges[e], 4);
+        valid = graph->edges[e] < graph->n;
+    }
+    fclose(f);
+    if (!valid)
+    {
+        fprintf(stderr, "[ERR] '%s': truncated or malformed contact graph\n", path);
+        graph_free(graph);
+        return -1;
+    }
+
+    graph->order = malloc((size_t)graph->n * sizeof(uint32_t));
+    for (uint32_t k = 0; k < graph->n; k++)
+        graph->order[k] = k;
+    Graph rcm;
+    graph_renumber(graph, &rcm);
+    uint32_t *bounds = malloc(((size_t)parts + 1) * sizeof(uint32_t));
+    graph_partition(graph, parts, bounds);
+    uint64_t cut = graph_edge_cut(graph, parts, bounds);
+    graph_partition(&rcm, parts, bounds);
+    uint64_t rcm_cut = graph_edge_cut(&rcm, parts, bounds);
+    free(bounds);
+    DEBUG_PRINT("Contact graph: %u vertices, %llu neighbor entries, bandwidth %u in file order and %u in RCM order,"
+                " %llu and %llu entries cut between %d parts\n", graph->n, (unsigned long long)n_edges,
+                graph_bandwidth(graph), graph_bandwidth(&rcm), (unsigned long long)cut, (unsigned long long)rcm_cut, parts);
+    if (rcm_cut <= cut)
+    {
+        graph_free(graph);
+        *graph = rcm;
+    }
+    else
+        graph_free(&rcm);
+    return 0;
+}
+
+// Grid cells in vertex order and back
+void graph_from_grid(const Graph *graph, const Cell *matrix, Cell *cells)
+{
+    for (uint32_t k = 0; k < graph->n; k++)
+        cells[k] = matrix[graph->order[k]];
+}
+
+void graph_to_grid(const Graph *graph, const Cell *cells, Cell *matrix)
+{
+    for (uint32_t k = 0; k < graph->n; k++)
+        matrix[graph->order[k]] = cells[k];
+}
+
+/*
+    Advances vertices [begin, end) from `cells` into `out`. Neighbor
+    indices point into `cells`, which may hold more cells than the graph
+    has vertices (the ghosts of a rank, see mpi_grid.h).
+*/
+void graph_update(const Graph *graph, const Cell *cells, Cell *out, uint32_t begin, uint32_t end,
+                  int time, uint64_t seed)
+{
+    for (uint32_t k = begin; k < end; k++)
+    {
+        out[k] = cells[k];
+        int inf_n = 0;
+        if (cells[k].status == SUSC_BLUE)
+        {
+            for (uint64_t e = graph->offsets[k]; e < graph->offsets[k + 1]; e++)
+                inf_n += cells[graph->edges[e]].status == SICK_C_RED;
+        }
+        CellRng rng;
+        cell_rng_seed(&rng, seed, time, graph->order[k]);
+        apply_rules(&out[k], inf_n, time, &rng);
+    }
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_timer.h>
+
+#define WIN_W 600
+#define WIN_H 600
+#define CELL_SIZE 10
+
+#define MAX_SPEED 30
+
+/*
+    SDL2 window shared by every backend. Quit with `Q`, decrease and
+    increase the simulation speed with `[` and `]`.
+*/
+typedef struct Gui
+{
+    SDL_Window *window;
+    SDL_Renderer *rend;
+    Uint32 sim_speed;
+} Gui;
+
+int gui_init(Gui *gui)
+{
+    assert(gui != NULL);
+    DEBUG_PRINT("Using SDL2 as GUI\n");
+    gui->sim_speed = 10;
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0)
+    {
+        printf("Error initializing SDL: %s\n", SDL_GetError());
+        return -1;
+    }
+    gui->window = SDL_CreateWindow("COVID-19 Simulator",
+                                   SDL_WINDOWPOS_CENTERED,
+                                   SDL_WINDOWPOS_CENTERED,
+                                   WIN_W, WIN_H, 0);
+    if (!gui->window)
+    {
+        printf("Error creating main window: %s\n", SDL_GetError());
+        SDL_Quit();
+        return -1;
+    }
+
+    gui->rend = SDL_CreateRenderer(gui->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!gui->rend)
+    {
+        printf("Error creating renderer: %s\n", SDL_GetError());
+        SDL_DestroyWindow(gui->window);
+        SDL_Quit();
+        return -1;
+    }
+    return 0;
+}
+
+// Handles pending events, returns false when the user asked to quit
+bool gui_poll(Gui *gui)
+{
+    bool keep_going = true;
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+        switch (event.type)
+        {
+        case SDL_QUIT:
+            keep_going = false;
+            break;
+        case SDL_KEYDOWN:
+            if (event.key.keysym.scancode == SDL_SCANCODE_RIGHTBRACKET)
+                gui->sim_speed = MIN(MAX_SPEED, gui->sim_speed + 1);
+            if (event.key.keysym.scancode == SDL_SCANCODE_LEFTBRACKET)
+                gui->sim_speed = MAX(gui->sim_speed - 1, 1);
+            if (event.key.keysym.scancode == SDL_SCANCODE_Q)
+                keep_going = false;
+            break;
+        default:
+            break;
+        }
+    }
+    return keep_going;
+}
+
+void gui_render(Gui *gui, Cell *matrix, int w, int h)
+{
+    SDL_Rect rect = {.w = CELL_SIZE, .h = CELL_SIZE};
+    SDL_RenderClear(gui->rend);
+    for (int i = 0; i < h; i++)
+    {
+        for (int j = 0; j < w; j++)
+        {
+            CellStatus current_status = matrix[(size_t)i * (size_t)w + (size_t)j].status;
+            rect.x = j * CELL_SIZE;
+            rect.y = i * CELL_SIZE;
+
+            SDL_SetRenderDrawColor(gui->rend,
+                                   (current_status >> 16) & 0xFF,
+                                   (current_status >> 8) & 0xFF,
+                                   current_status & 0xFF,
+                                   255);
+            SDL_RenderFillRect(gui->rend, &rect);
+        }
+    }
+    SDL_RenderPresent(gui->rend);
+}
+
+void gui_delay(Gui *gui)
+{
+    SDL_Delay(1000 / gui->sim_speed);
+}
+
+void gui_destroy(Gui *gui)
+{
+    SDL_DestroyRenderer(gui->rend);
+    SDL_DestroyWindow(gui->window);
+    SDL_Quit();
+}
@@ -0,0 +1,130 @@
+#include <stdint.h>
+
+/*
+    Row kernel specialized at build time (make SPEC=t) for SPEC_COLS columns
+    and the rule constants of a rule spec, both emitted into kernel_gen.h by
+    rules/gen_kernel.sh. Columns wrap with a mask when SPEC_COLS is a power
+    of two and the rules compare against literals. The loops keep `cols` as
+    their bound: with a compile-time trip count GCC vectorizes the AoS loads
+    worse and the kernel gets slower.
+
+    It computes exactly the same step as apply_rules() with the same
+    parameters, the engine only picks it when they match. Like the generic
+    kernels it is compiled for each instruction set and the widest one the
+    CPU supports is used.
+*/
+
+#if SPEC_COLS_POW2
+#define SPEC_WRAP(j) ((j) & (SPEC_COLS - 1))
+#else
+#define SPEC_WRAP(j) (((j) + SPEC_COLS) % SPEC_COLS)
+#endif
+
+#define SPEC_CHUNK MIN(KERNEL_CHUNK, SPEC_COLS)
+
+const RuleParams spec_rules = {
+    .disease_strength = SPEC_DISEASE_STRENGTH,
+    .susceptibility = {SPEC_SUSCEPTIBILITY_CHILD, SPEC_SUSCEPTIBILITY_ADULT, SPEC_SUSCEPTIBILITY_ELDER},
+    .risk_susceptibility = SPEC_RISK_SUSCEPTIBILITY,
+    .contagious_after = SPEC_CONTAGIOUS_AFTER,
+    .isolation_after = SPEC_ISOLATION_AFTER,
+    .isolation_chance = SPEC_ISOLATION_CHANCE,
+    .resolution_after = SPEC_RESOLUTION_AFTER,
+    .death_chance = {SPEC_DEATH_CHANCE_CHILD, SPEC_DEATH_CHANCE_ADULT, SPEC_DEATH_CHANCE_ELDER},
+    .vaccine_protection = SPEC_VACCINE_PROTECTION};
+
+/*
+    apply_rules() with the constants of spec_rules, draws happen in the same
+    order. Left for the compiler to inline: forcing it lets the branches
+    around the draws be if-converted, which is slower.
+*/
+static void spec_apply_rules(Cell *target, int inf_n, int time, CellRng *rng)
+{
+    static const int susc_by_age[3] = {SPEC_SUSCEPTIBILITY_CHILD, SPEC_SUSCEPTIBILITY_ADULT, SPEC_SUSCEPTIBILITY_ELDER};
+    static const double death_by_age[3] = {SPEC_DEATH_CHANCE_CHILD, SPEC_DEATH_CHANCE_ADULT, SPEC_DEATH_CHANCE_ELDER};
+    bool known_age = (unsigned)target->age < 3;
+
+    if (target->status == SUSC_BLUE && inf_n != 0)
+    {
+        int susc = (known_age ? susc_by_age[target->age] : 0) +
+                   ((target->risk_disease || target->risk_job) ? SPEC_RISK_SUSCEPTIBILITY : 0);
+        double get_sick_chance = ((inf_n / 8) * SPEC_DISEASE_STRENGTH) + (susc / 100);
+        if (((cell_rand(rng) % 100) / 100) < get_sick_chance)
+        {
+            target->status = SICK_NC_ORANGE;
+            target->contagion_t = time;
+        }
+    }
+    if (target->status == SICK_NC_ORANGE && time - target->contagion_t == SPEC_CONTAGIOUS_AFTER)
+        target->status = SICK_C_RED;
+    if (target->status == SICK_C_RED && time - target->contagion_t == SPEC_ISOLATION_AFTER)
+    {
+        if ((cell_rand(rng) % 100) < SPEC_ISOLATION_CHANCE)
+            target->status = ISOLATED_YELLOW;
+    }
+    if (is_sick(*target) && time - target->contagion_t == SPEC_RESOLUTION_AFTER)
+    {
+        double death_chance = (known_age ? death_by_age[target->age] : 0) -
+                              (target->vaccinated ? SPEC_VACCINE_PROTECTION : 0);
+        if ((cell_rand(rng) % 100) < death_chance)
+            target->status = DEAD_BLACK;
+        else
+            target->status = CURED_GREEN;
+    }
+}
+
+static inline __attribute__((always_inline)) void spec_chunked(Cell *above, Cell *row, Cell *below, Cell *out,
+                                                               int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    assert(cols == SPEC_COLS);
+    int32_t vertical[SPEC_CHUNK + 2];
+    int32_t inf_n[SPEC_CHUNK];
+    for (int c0 = 0; c0 < cols; c0 += SPEC_CHUNK)
+    {
+        const int len = MIN(SPEC_CHUNK, cols - c0);
+        const int left = SPEC_WRAP(c0 - 1);
+        const int right = SPEC_WRAP(c0 + len);
+        vertical[0] = (above[left].status == SICK_C_RED) + (row[left].status == SICK_C_RED) + (below[left].status == SICK_C_RED);
+        vertical[len + 1] = (above[right].status == SICK_C_RED) + (row[right].status == SICK_C_RED) + (below[right].status == SICK_C_RED);
+        for (int k = 0; k < len; k++)
+            vertical[k + 1] = (above[c0 + k].status == SICK_C_RED) +
+                              (row[c0 + k].status == SICK_C_RED) +
+                              (below[c0 + k].status == SICK_C_RED);
+        for (int k = 0; k < len; k++)
+            inf_n[k] = vertical[k] + vertical[k + 1] + vertical[k + 2] - (row[c0 + k].status == SICK_C_RED);
+
+        for (int k = 0; k < len; k++)
+        {
+            out[c0 + k] = row[c0 + k];
+            CellRng rng;
+            cell_rng_seed(&rng, seed, time, cell_base + (uint64_t)(c0 + k));
+            spec_apply_rules(&out[c0 + k], inf_n[k], time, &rng);
+        }
+    }
+}
+
+void kernel_specialized(Cell *above, Cell *row, Cell *below, Cell *out,
+                        int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    spec_chunked(above, row, below, out, cols, time, seed, cell_base);
+}
+
+#if ENGINE_X86
+__attribute__((target("sse4.2"))) void kernel_specialized_sse42(Cell *above, Cell *row, Cell *below, Cell *out,
+                                                                int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    spec_chunked(above, row, below, out, cols, time, seed, cell_base);
+}
+
+__attribute__((target("avx2"))) void kernel_specialized_avx2(Cell *above, Cell *row, Cell *below, Cell *out,
+                                                             int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    spec_chunked(above, row, below, out, cols, time, seed, cell_base);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void kernel_specialized_avx512(Cell *above, Cell *row, Cell *below, Cell *out,
+                                                                           int cols, int time, uint64_t seed, uint64_t cell_base)
+{
+    spec_chunked(above, row, below, out, cols, time, seed, cell_base);
+}
+#endif
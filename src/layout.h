@@ -0,0 +1,239 @@
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Storage order of the grid (--layout=rows|morton|hilbert). Row-major
+    keeps the rows above and below a cell a whole row apart, so on wide
+    grids each row reads three distant streams and a step touches every
+    page of the grid three times. The curve layouts store the grid in
+    tiles of LAYOUT_TILE_ROWS rows of LAYOUT_TILE_COLS cells, row-major
+    inside a tile, and lay the tiles out along a Morton (Z-order) or
+    Hilbert curve: a tile and the tiles around it are close in memory
+    whatever the width, and a step sweeps the grid tile by tile in storage
+    order.
+
+    Each row of a tile is stored between two ghost cells holding the
+    columns on its sides, so the row kernels run on the tile rows in place,
+    with the same per-cell draws: every layout gives the same grid.
+    Tracing, rendering and dumping see a row-major copy made by
+    layout_unpack().
+*/
+
+#define LAYOUT_TILE_ROWS 32
+#define LAYOUT_TILE_COLS 256                // Wide enough that the ghost cells are little work
+#define LAYOUT_STRIDE (LAYOUT_TILE_COLS + 2) // A tile row and its ghost cells
+
+typedef enum LayoutKind
+{
+    LAYOUT_ROWS,
+    LAYOUT_MORTON,
+    LAYOUT_HILBERT,
+    LAYOUT_KINDS
+} LayoutKind;
+
+const char *layout_names[LAYOUT_KINDS] = {"rows", "morton", "hilbert"};
+
+typedef struct Layout
+{
+    LayoutKind kind;
+    int w;
+    int h;
+    int tile_rows;
+    int tile_cols;
+    uint32_t n_tiles;
+    uint32_t *slot; // Storage slot of tile (ti, tj), at ti * tile_cols + tj
+    uint32_t *tile; // Tile stored at each slot
+} Layout;
+
+typedef struct LayoutKey
+{
+    uint64_t key;
+    uint32_t tile;
+} LayoutKey;
+
+// Resolves --layout, NULL is row-major. Returns -1 on an unknown name.
+int layout_select(const char *name, LayoutKind *kind)
+{
+    *kind = LAYOUT_ROWS;
+    if (name == NULL)
+        return 0;
+    for (int k = 0; k < LAYOUT_KINDS; k++)
+    {
+        if (strcmp(name, layout_names[k]) == 0)
+        {
+            *kind = (LayoutKind)k;
+            return 0;
+        }
+    }
+    fprintf(stderr, "[ERR] Unknown layout '%s', expected rows, morton or hilbert\n", name);
+    return -1;
+}
+
+// Interleaves the bits of x (even) and y (odd)
+static uint64_t layout_morton_key(uint32_t x, uint32_t y)
+{
+    uint64_t key = 0;
+    for (int b = 0; b < 32; b++)
+        key |= (uint64_t)((x >> b) & 1) << (2 * b) | (uint64_t)((y >> b) & 1) << (2 * b + 1);
+    return key;
+}
+
+// Distance of (x, y) along the Hilbert curve filling an n x n square, n a power of 2
+static uint64_t layout_hilbert_key(uint32_t x, uint32_t y, uint32_t n)
+{
+    uint64_t key = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2)
+    {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        key += (uint64_t)s * s * ((3 * rx) ^ ry);
+        // Rotates the quadrant so the curve enters it the right way
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            uint32_t temp = x;
+            x = y;
+            y = temp;
+        }
+    }
+    return key;
+}
+
+static int layout_key_cmp(const void *a, const void *b)
+{
+    const LayoutKey *x = a;
+    const LayoutKey *y = b;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+/*
+    Orders the tiles of a `w` x `h` grid along the curve of `kind` (not
+    LAYOUT_ROWS). Tiles on the right and bottom edges may be partial, they
+    still take a whole tile of storage.
+*/
+void layout_init(Layout *layout, LayoutKind kind, int w, int h)
+{
+    assert(layout != NULL && kind != LAYOUT_ROWS);
+    layout->kind = kind;
+    layout->w = w;
+    layout->h = h;
+    layout->tile_rows = (h + LAYOUT_TILE_ROWS - 1) / LAYOUT_TILE_ROWS;
+    layout->tile_cols = (w + LAYOUT_TILE_COLS - 1) / LAYOUT_TILE_COLS;
+    layout->n_tiles = (uint32_t)layout->tile_rows * (uint32_t)layout->tile_cols;
+    uint32_t side = 1;
+    while (side < (uint32_t)MAX(layout->tile_rows, layout->tile_cols))
+        side *= 2;
+
+    LayoutKey *keys = malloc(layout->n_tiles * sizeof(LayoutKey));
+    for (uint32_t t = 0; t < layout->n_tiles; t++)
+    {
+        uint32_t x = t % (uint32_t)layout->tile_cols;
+        uint32_t y = t / (uint32_t)layout->tile_cols;
+        keys[t].key = kind == LAYOUT_MORTON ? layout_morton_key(x, y) : layout_hilbert_key(x, y, side);
+        keys[t].tile = t;
+    }
+    qsort(keys, layout->n_tiles, sizeof(LayoutKey), layout_key_cmp);
+    layout->slot = malloc(layout->n_tiles * sizeof(uint32_t));
+    layout->tile = malloc(layout->n_tiles * sizeof(uint32_t));
+    for (uint32_t s = 0; s < layout->n_tiles; s++)
+    {
+        layout->tile[s] = keys[s].tile;
+        layout->slot[keys[s].tile] = s;
+    }
+    free(keys);
+}
+
+void layout_free(Layout *layout)
+{
+    free(layout->slot);
+    free(layout->tile);
+}
+
+// Cells to allocate for a grid stored in `layout`
+size_t layout_cells(const Layout *layout)
+{
+    return (size_t)layout->n_tiles * LAYOUT_TILE_ROWS * LAYOUT_STRIDE;
+}
+
+// Position of cell (i, j) in storage
+size_t layout_index(const Layout *layout, int i, int j)
+{
+    size_t slot = layout->slot[(i / LAYOUT_TILE_ROWS) * layout->tile_cols + j / LAYOUT_TILE_COLS];
+    return slot * LAYOUT_TILE_ROWS * LAYOUT_STRIDE + (size_t)(i % LAYOUT_TILE_ROWS) * LAYOUT_STRIDE + 1 +
+           (size_t)(j % LAYOUT_TILE_COLS);
+}
+
+// Copies the ghost columns of the tile stored at `slot` from the tiles on its sides
+void layout_fill_ghosts(const Layout *layout, Cell *cells, uint32_t slot)
+{
+    int w = layout->w;
+    int ti = (int)(layout->tile[slot] / (uint32_t)layout->tile_cols);
+    int c0 = (int)(layout->tile[slot] % (uint32_t)layout->tile_cols) * LAYOUT_TILE_COLS;
+    int len = MIN(LAYOUT_TILE_COLS, w - c0);
+    int row_end = MIN(layout->h, (ti + 1) * LAYOUT_TILE_ROWS);
+    for (int i = ti * LAYOUT_TILE_ROWS; i < row_end; i++)
+    {
+        Cell *row = &cells[layout_index(layout, i, c0) - 1];
+        row[0] = cells[layout_index(layout, i, (c0 - 1 + w) % w)];
+        row[len + 1] = cells[layout_index(layout, i, (c0 + len) % w)];
+    }
+}
+
+// Copies the row-major `grid` into `cells`, stored in `layout`
+void layout_pack(const Layout *layout, const Cell *grid, Cell *cells)
+{
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < layout->h; i++)
+    {
+        for (int j = 0; j < layout->w; j += LAYOUT_TILE_COLS)
+            memcpy(&cells[layout_index(layout, i, j)], &grid[(size_t)i * (size_t)layout->w + (size_t)j],
+                   (size_t)MIN(LAYOUT_TILE_COLS, layout->w - j) * sizeof(Cell));
+    }
+    for (uint32_t s = 0; s < layout->n_tiles; s++)
+        layout_fill_ghosts(layout, cells, s);
+}
+
+// Copies `cells`, stored in `layout`, into the row-major `grid`
+void layout_unpack(const Layout *layout, const Cell *cells, Cell *grid)
+{
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < layout->h; i++)
+    {
+        for (int j = 0; j < layout->w; j += LAYOUT_TILE_COLS)
+            memcpy(&grid[(size_t)i * (size_t)layout->w + (size_t)j], &cells[layout_index(layout, i, j)],
+                   (size_t)MIN(LAYOUT_TILE_COLS, layout->w - j) * sizeof(Cell));
+    }
+}
+
+/*
+    Updates the tile stored at `slot` of `cells` into `upd`, both stored in
+    `layout`. The kernel reads the padded rows in place and also computes
+    the ghost columns of `upd`, which are garbage until layout_fill_ghosts()
+    runs on every tile of the step.
+*/
+void layout_update_tile(const Layout *layout, RowKernel kernel, Cell *cells, Cell *upd, uint32_t slot,
+                        int time, uint64_t seed)
+{
+    int w = layout->w;
+    int h = layout->h;
+    int ti = (int)(layout->tile[slot] / (uint32_t)layout->tile_cols);
+    int c0 = (int)(layout->tile[slot] % (uint32_t)layout->tile_cols) * LAYOUT_TILE_COLS;
+    int len = MIN(LAYOUT_TILE_COLS, w - c0);
+    int row_end = MIN(h, (ti + 1) * LAYOUT_TILE_ROWS);
+    for (int i = ti * LAYOUT_TILE_ROWS; i < row_end; i++)
+    {
+        size_t at = layout_index(layout, i, c0) - 1;
+        Cell *above = &cells[layout_index(layout, (i - 1 + h) % h, c0) - 1];
+        Cell *below = &cells[layout_index(layout, (i + 1) % h, c0) - 1];
+        // Cell k of a padded row is global column c0 + k - 1
+        kernel(above, &cells[at], below, &upd[at], len + 2, time, seed, (uint64_t)i * (uint64_t)w + (uint64_t)c0 - 1);
+    }
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <omp.h>
+
+#include "utils.h"
+#include "simulation.h"
+#include "trace.h"
+#include "engine.h"
+#include "raster.h"
+#include "mobility.h"
+#include "covidsim.h"
+
+/*
+    libcovidsim, see covidsim.h for the interface. Steps run the double
+    buffered row-major engine on an OpenMP team, like build/main-omp, and
+    each step ends with one pass over the grid that writes the status plane
+    and counts the statuses for the series.
+*/
+
+struct CovidSim
+{
+    int rows;
+    int cols;
+    int time;
+    unsigned int seed;
+    int threads;
+    RuleParams rules;
+    RowKernel kernel;
+    Cell *matrix;
+    Cell *upd_matrix;
+    uint8_t *status; // Plane of status codes
+    int64_t counts[STATUS_KINDS];
+    int64_t *series[STATUS_KINDS];
+    int64_t length;   // Steps in the series
+    int64_t capacity; // Of each column
+};
+
+// Refreshes the status plane and the counts, then appends them to the series. Returns -1 on error.
+static int covidsim_observe(CovidSim *sim)
+{
+    int64_t counts[STATUS_KINDS] = {0};
+    int rows = sim->rows;
+    int cols = sim->cols;
+#pragma omp parallel for num_threads(sim->threads) reduction(+ : counts[:STATUS_KINDS])
+    for (int i = 0; i < rows; i++)
+    {
+        const Cell *row = &sim->matrix[(size_t)i * (size_t)cols];
+        uint8_t *status = &sim->status[(size_t)i * (size_t)cols];
+        for (int j = 0; j < cols; j++)
+        {
+            int k = status_index(row[j].status);
+            status[j] = (uint8_t)k;
+            counts[k]++;
+        }
+    }
+    if (sim->length == sim->capacity)
+    {
+        int64_t capacity = MAX(2 * sim->capacity, 256);
+        for (int k = 0; k < STATUS_KINDS; k++)
+        {
+            int64_t *column = realloc(sim->series[k], (size_t)capacity * sizeof(int64_t));
+            if (column == NULL)
+            {
+                fprintf(stderr, "[ERR] Can't grow the series to %lld steps\n", (long long)capacity);
+                return -1;
+            }
+            sim->series[k] = column;
+        }
+        sim->capacity = capacity;
+    }
+    for (int k = 0; k < STATUS_KINDS; k++)
+    {
+        sim->counts[k] = counts[k];
+        sim->series[k][sim->length] = counts[k];
+    }
+    sim->length++;
+    return 0;
+}
+
+CovidSim *covidsim_create(const CovidConfig *config)
+{
+    if (config == NULL || config->rows < 3 || config->cols < 3)
+    {
+        fprintf(stderr, "[ERR] A simulation needs at least 3 rows and 3 columns\n");
+        return NULL;
+    }
+    CovidSim *sim = calloc(1, sizeof(CovidSim));
+    if (sim == NULL)
+        return NULL;
+    sim->rows = config->rows;
+    sim->cols = config->cols;
+    sim->seed = config->seed;
+    sim->threads = config->threads > 0 ? config->threads : omp_get_max_threads();
+    sim->rules = (RuleParams)RULES_DEFAULT;
+    if (config->rules_path != NULL && load_rules(config->rules_path, &sim->rules) != 0)
+    {
+        free(sim);
+        return NULL;
+    }
+    rule_params = sim->rules;
+    KernelKind kernel_kind;
+    if (mobility_enabled())
+    {
+        fprintf(stderr, "[ERR] libcovidsim doesn't run the mobility rules\n");
+        free(sim);
+        return NULL;
+    }
+    if (kernel_select(config->kernel, sim->cols, &kernel_kind) != 0)
+    {
+        free(sim);
+        return NULL;
+    }
+    sim->kernel = kernel_table[kernel_kind];
+
+    size_t n_cells = (size_t)sim->rows * (size_t)sim->cols;
+    sim->matrix = malloc(n_cells * sizeof(Cell));
+    sim->upd_matrix = malloc(n_cells * sizeof(Cell));
+    sim->status = malloc(n_cells);
+    if (sim->matrix == NULL || sim->upd_matrix == NULL || sim->status == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't allocate a %dx%d grid\n", sim->rows, sim->cols);
+        covidsim_destroy(sim);
+        return NULL;
+    }
+    srand(sim->seed);
+    if (config->population_path == NULL)
+        init_cell_matrix(sim->matrix, sim->cols, sim->rows);
+    else if (raster_load_rows(config->population_path, sim->matrix, sim->rows, sim->cols, 0, sim->rows) != 0)
+    {
+        covidsim_destroy(sim);
+        return NULL;
+    }
+    if (covidsim_observe(sim) != 0)
+    {
+        covidsim_destroy(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+void covidsim_destroy(CovidSim *sim)
+{
+    if (sim == NULL)
+        return;
+    free(sim->matrix);
+    free(sim->upd_matrix);
+    free(sim->status);
+    for (int k = 0; k < STATUS_KINDS; k++)
+        free(sim->series[k]);
+    free(sim);
+}
+
+int covidsim_step(CovidSim *sim)
+{
+    return covidsim_run(sim, 1);
+}
+
+int covidsim_run(CovidSim *sim, int steps)
+{
+    rule_params = sim->rules;
+    int rows = sim->rows;
+    int cols = sim->cols;
+    for (int s = 0; s < steps; s++)
+    {
+#pragma omp parallel for num_threads(sim->threads)
+        for (int i = 0; i < rows; i++)
+            engine_update_row(sim->kernel, sim->matrix, sim->upd_matrix, cols, rows, i, sim->time, sim->seed, 0);
+        Cell *temp = sim->matrix;
+        sim->matrix = sim->upd_matrix;
+        sim->upd_matrix = temp;
+        sim->time++;
+        if (covidsim_observe(sim) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int covidsim_time(const CovidSim *sim)
+{
+    return sim->time;
+}
+
+int covidsim_rows(const CovidSim *sim)
+{
+    return sim->rows;
+}
+
+int covidsim_cols(const CovidSim *sim)
+{
+    return sim->cols;
+}
+
+const uint8_t *covidsim_status(const CovidSim *sim)
+{
+    return sim->status;
+}
+
+const int64_t *covidsim_counts(const CovidSim *sim)
+{
+    return sim->counts;
+}
+
+void covidsim_series(const CovidSim *sim, CovidSeries *series)
+{
+    series->length = sim->length;
+    for (int k = 0; k < STATUS_KINDS; k++)
+        series->counts[k] = sim->series[k];
+}
+
+int covidsim_snapshot(const CovidSim *sim, const char *path)
+{
+    return dump_grid(path, sim->matrix, sim->cols, sim->rows);
+}
@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "utils.h"
+#include "simulation.h"
+#include "perf.h"
+#include "options.h"
+#include "trace.h"
+#include "engine.h"
+#include "gui.h"
+#include "ooc.h"
+#include "raster.h"
+#include "mobility.h"
+
+/*
+    Out-of-core backend: the grid lives in a memory-mapped file (--grid) and
+    is updated in place, one band of rows at a time. Each step streams
+    through the file with a window of three bands holding the previous state
+    of the band being updated and of its neighbors, while the band after
+    them is read ahead. Bands that didn't change aren't written back.
+    Long-range contacts of a step are drawn from the bands written by the
+    step before (see mobility.h), so the grid is still read once per step.
+*/
+
+int main(int argc, char const *argv[])
+{
+    Options opts;
+    if (parse_options(argc, argv, &opts, false) != 0)
+        return -1;
+    int rows = opts.rows;
+    int cols = opts.cols;
+    bool use_gui = opts.use_gui;
+    // Every band is streamed whole, there are no tiles to skip
+    if (opts.tile_size > 0)
+    {
+        fprintf(stderr, "[ERR] --tiles is only supported by main and main-omp\n");
+        return -1;
+    }
+    // Nor curve orders, the bands are read and written as row-major rows
+    if (opts.layout != NULL && strcmp(opts.layout, "rows") != 0)
+    {
+        fprintf(stderr, "[ERR] --layout is only supported by main and main-omp\n");
+        return -1;
+    }
+    // Bands are streamed one after another, by a single thread
+    if (opts.sync_neighbors)
+    {
+        fprintf(stderr, "[ERR] --sync=neighbors is only supported by main-omp\n");
+        return -1;
+    }
+    if (opts.telemetry != NULL)
+    {
+        fprintf(stderr, "[ERR] --telemetry is only supported by main-omp, main-mpi and main-hyb\n");
+        return -1;
+    }
+
+    if (opts.rules_path != NULL && load_rules(opts.rules_path, &rule_params) != 0)
+        return -1;
+
+    KernelKind kernel_kind;
+    if (kernel_select(opts.kernel, cols, &kernel_kind) != 0)
+        return -1;
+    RowKernel kernel = kernel_table[kernel_kind];
+    DEBUG_PRINT("Using the %s kernel\n", kernel_names[kernel_kind]);
+
+    Gui gui;
+    if (use_gui && gui_init(&gui) != 0)
+        return -1;
+
+    // The bands stream the grid row by row, a graph links cells anywhere
+    if (opts.graph_path != NULL)
+    {
+        fprintf(stderr, "[ERR] The out-of-core backend needs the grid, --graph is not supported\n");
+        return -1;
+    }
+
+    Mobility mob;
+    bool mobility = mobility_enabled();
+    if (mobility && mobility_init(&mob, 1) != 0)
+        return -1;
+
+    OocGrid grid;
+    if (ooc_open(&grid, opts.grid_path, rows, cols, opts.band_rows) != 0)
+        return -1;
+    DEBUG_PRINT("%d bands of %d rows\n", grid.n_bands, grid.band_rows);
+
+    // Init random number generation
+    srand(opts.seed);
+
+    Raster raster;
+    if (opts.population_path != NULL && raster_open(&raster, opts.population_path, rows, cols) != 0)
+        return -1;
+
+    // Band by band, rand() visits the cells in the same order as with a whole grid
+    FILE *trace = trace_open(opts.trace_path);
+    TraceSum sum;
+    trace_begin(&sum);
+    for (int b = 0; b < grid.n_bands; b++)
+    {
+        if (opts.population_path == NULL)
+            init_cell_matrix(ooc_band(&grid, b), cols, ooc_band_len(&grid, b));
+        else
+            raster_read_rows(&raster, ooc_band(&grid, b), (long)b * grid.band_rows, ooc_band_len(&grid, b));
+        trace_add(&sum, ooc_band(&grid, b), (size_t)ooc_band_len(&grid, b) * (size_t)cols);
+        if (mobility)
+            mobility_contacts(&mob, 0, ooc_band(&grid, b), cols, rows, (long)b * grid.band_rows,
+                              ooc_band_len(&grid, b), 0, cols, 0, opts.seed);
+        ooc_writeback(&grid, b);
+        ooc_release(&grid, b);
+    }
+    if (trace != NULL)
+        trace_end(trace, 0, &sum);
+    if (opts.population_path != NULL)
+        raster_close(&raster);
+
+    // Previous state of the bands around the one being updated
+    size_t band_cells = (size_t)grid.band_rows * (size_t)cols;
+    size_t row_bytes = (size_t)cols * sizeof(Cell);
+    Cell *prev = grid_alloc(band_cells);
+    Cell *cur = grid_alloc(band_cells);
+    Cell *next = grid_alloc(band_cells);
+    Cell *out = grid_alloc(band_cells);
+    // Rows wrap: the last row of the grid and the first one, before the step
+    Cell *wrap_above = grid_alloc((size_t)cols);
+    Cell *wrap_below = grid_alloc((size_t)cols);
+    if (prev == NULL || cur == NULL || next == NULL || out == NULL || wrap_above == NULL || wrap_below == NULL)
+    {
+        ooc_close(&grid);
+        return -1;
+    }
+
+    PERF_INIT(1);
+    PERF_THREAD_OPEN(0);
+
+    double bytes_read = 0;
+    double bytes_written = 0;
+    double start = perf_now();
+    for (int sim_t = 0; sim_t < opts.steps; sim_t++)
+    {
+        if (use_gui)
+        {
+            if (!gui_poll(&gui))
+                break;
+
+            PERF_BEGIN(0, PHASE_RENDER);
+            gui_render(&gui, grid.cells, cols, rows);
+            PERF_END(0, PHASE_RENDER);
+        }
+
+        PERF_BEGIN(0, PHASE_COPY);
+        memcpy(wrap_above, &grid.cells[(size_t)(rows - 1) * (size_t)cols], row_bytes);
+        memcpy(wrap_below, grid.cells, row_bytes);
+        if (grid.n_bands > 1)
+            ooc_prefetch(&grid, 1);
+        memcpy(cur, ooc_band(&grid, 0), ooc_band_bytes(&grid, 0));
+        bytes_read += (double)ooc_band_bytes(&grid, 0);
+        PERF_END(0, PHASE_COPY);
+
+        int prev_len = 0;
+        size_t next_exposed = 0;
+        if (mobility)
+            mobility_merge(&mob);
+        if (trace != NULL)
+            trace_begin(&sum);
+        for (int b = 0; b < grid.n_bands; b++)
+        {
+            int len = ooc_band_len(&grid, b);
+            bool last = b == grid.n_bands - 1;
+
+            PERF_BEGIN(0, PHASE_COPY);
+            if (b + 2 < grid.n_bands)
+                ooc_prefetch(&grid, b + 2);
+            if (!last)
+            {
+                memcpy(next, ooc_band(&grid, b + 1), ooc_band_bytes(&grid, b + 1));
+                bytes_read += (double)ooc_band_bytes(&grid, b + 1);
+            }
+            PERF_END(0, PHASE_COPY);
+
+            PERF_BEGIN(0, PHASE_UPDATE);
+            Cell *band_above = b == 0 ? wrap_above : &prev[(size_t)(prev_len - 1) * (size_t)cols];
+            Cell *band_below = last ? wrap_below : next;
+#pragma omp parallel for
+            for (int i = 0; i < len; i++)
+            {
+                Cell *above = i == 0 ? band_above : &cur[(size_t)(i - 1) * (size_t)cols];
+                Cell *below = i == len - 1 ? band_below : &cur[(size_t)(i + 1) * (size_t)cols];
+                uint64_t global_row = (uint64_t)b * (uint64_t)grid.band_rows + (uint64_t)i;
+                kernel(above, &cur[(size_t)i * (size_t)cols], below, &out[(size_t)i * (size_t)cols],
+                       cols, sim_t, opts.seed, global_row * (uint64_t)cols);
+            }
+            if (mobility)
+            {
+                long first_row = (long)b * grid.band_rows;
+                mobility_infect(&mob, &next_exposed, out, cols, first_row, len, sim_t);
+                mobility_contacts(&mob, 0, out, cols, rows, first_row, len, 0, cols, sim_t + 1, opts.seed);
+            }
+            PERF_END(0, PHASE_UPDATE);
+
+            PERF_BEGIN(0, PHASE_COPY);
+            if (trace != NULL)
+                trace_add(&sum, out, (size_t)len * (size_t)cols);
+            size_t bytes = ooc_band_bytes(&grid, b);
+            if (memcmp(out, cur, bytes) != 0)
+            {
+                memcpy(ooc_band(&grid, b), out, bytes);
+                ooc_writeback(&grid, b);
+                bytes_written += (double)bytes;
+            }
+            ooc_release(&grid, b);
+            PERF_END(0, PHASE_COPY);
+
+            // Roll the window
+            Cell *temp = prev;
+            prev = cur;
+            cur = next;
+            next = temp;
+            prev_len = len;
+        }
+
+        if (trace != NULL)
+            trace_end(trace, sim_t + 1, &sum);
+
+        // Debugging
+        DEBUG_PRINT("\n\tTime: %d\n", sim_t);
+
+        if (use_gui)
+            gui_delay(&gui);
+    }
+    double elapsed = perf_now() - start;
+
+    DEBUG_PRINT("Simulation finished!\n");
+    // The point of this backend, reported by every build
+    fprintf(stderr, "[OOC] Read %.1f MB, wrote %.1f MB in %.3f s: %.1f MB/s\n",
+            bytes_read / 1e6, bytes_written / 1e6, elapsed,
+            (bytes_read + bytes_written) / 1e6 / MAX(elapsed, 1e-9));
+    if (trace != NULL)
+        fclose(trace);
+    if (opts.dump_path != NULL)
+        dump_grid(opts.dump_path, grid.cells, cols, rows);
+    PERF_REPORT("main-ooc", (double)rows * cols * opts.steps, sizeof(Cell));
+    PERF_CLOSE();
+
+    // Cleanup
+    free(prev);
+    free(cur);
+    free(next);
+    free(out);
+    free(wrap_above);
+    free(wrap_below);
+    ooc_close(&grid);
+    if (mobility)
+        mobility_free(&mob);
+
+    if (use_gui)
+        gui_destroy(&gui);
+
+    return 0;
+}
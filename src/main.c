@@ -3,183 +3,256 @@
 #include <stdbool.h>
 #include <time.h>
 
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_timer.h>
-
-#define WIN_W 600
-#define WIN_H 600
-#define CELL_SIZE 10
-
-#define MAX_SPEED 30
-#define SIM_LIMIT 120
-
 #include "utils.h"
 #include "simulation.h"
+#include "perf.h"
+#include "options.h"
+#include "trace.h"
+#include "engine.h"
+#include "mobility.h"
+#include "tiles.h"
+#include "raster.h"
+#include "graph.h"
+#include "layout.h"
+#include "gui.h"
 
 int main(int argc, char const *argv[])
 {
-    unsigned int MY_RANDOM_SEED =
-#if defined(DEBUG) && DEBUG
-        31415926;
-#else
-        (unsigned int)time(NULL);
-#endif
-
-    if (argc < 4)
+    Options opts;
+    if (parse_options(argc, argv, &opts, false) != 0)
+        return -1;
+    int rows = opts.rows;
+    int cols = opts.cols;
+    bool use_gui = opts.use_gui;
+    // One thread has no neighbors to wait for
+    if (opts.sync_neighbors)
     {
-        fprintf(stderr, "Usage: %s <rows> <cols> <t|f>", argv[0]);
+        fprintf(stderr, "[ERR] --sync=neighbors is only supported by main-omp\n");
         return -1;
     }
-    int rows = atoi(argv[1]);
-    int cols = atoi(argv[2]);
-    bool use_gui = (*argv[3]) == 't';
-
-    if (rows < 2 || cols < 2)
+    if (opts.telemetry != NULL)
     {
-        fprintf(stderr, "[ERR] At least 2 rows and cols, got %d and %d", rows, cols);
+        fprintf(stderr, "[ERR] --telemetry is only supported by main-omp, main-mpi and main-hyb\n");
         return -1;
     }
 
-    SDL_Window *window;
-    SDL_Renderer *rend;
-    if (use_gui)
+    if (opts.rules_path != NULL && load_rules(opts.rules_path, &rule_params) != 0)
+        return -1;
+
+    LayoutKind layout_kind;
+    if (layout_select(opts.layout, &layout_kind) != 0)
+        return -1;
+    bool curve = layout_kind != LAYOUT_ROWS;
+    Layout layout;
+    if (curve)
+        layout_init(&layout, layout_kind, cols, rows);
+
+    // The curve layouts and tiles run the kernel on windows, never on whole rows
+    KernelKind kernel_kind;
+    if (kernel_select(opts.kernel, curve || opts.tile_size > 0 ? 0 : cols, &kernel_kind) != 0)
+        return -1;
+    RowKernel kernel = kernel_table[kernel_kind];
+    DEBUG_PRINT("Using the %s kernel\n", kernel_names[kernel_kind]);
+
+    Gui gui;
+    if (use_gui && gui_init(&gui) != 0)
+        return -1;
+
+    // Init random number generation
+    srand(opts.seed);
+
+    Cell *matrix = grid_alloc(grid_cells(cols, rows));
+    // Rolling updates only need the wrapping rows and two output rows
+    size_t n_cells = curve ? layout_cells(&layout) : grid_cells(cols, rows);
+    Cell *upd_matrix = grid_alloc(opts.rolling ? 4 * (size_t)cols : n_cells);
+    if (matrix == NULL || upd_matrix == NULL)
+        return -1;
+
+    if (opts.population_path == NULL)
+        init_cell_matrix(matrix, cols, rows);
+    else if (raster_load_rows(opts.population_path, matrix, rows, cols, 0, rows) != 0)
+        return -1;
+
+    FILE *trace = trace_open(opts.trace_path);
+    if (trace != NULL)
+        trace_step(trace, 0, matrix, cols, rows);
+
+    TileMap tiles;
+    if (opts.tile_size > 0)
+        tiles_init(&tiles, opts.tile_size, 1, matrix, cols, rows);
+
+    Mobility mob;
+    bool mobility = mobility_enabled();
+    if (mobility)
     {
-        DEBUG_PRINT("Using SDL2 as GUI\n");
-        if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0)
-        {
-            printf("Error initializing SDL: %s\n", SDL_GetError());
+        if (mobility_init(&mob, 1) != 0)
             return -1;
-        }
-        window = SDL_CreateWindow("COVID-19 Simulator",
-                                  SDL_WINDOWPOS_CENTERED,
-                                  SDL_WINDOWPOS_CENTERED,
-                                  WIN_W, WIN_H, 0);
-        if (!window)
+        // Later steps draw them as rows are updated
+        mobility_contacts(&mob, 0, matrix, cols, rows, 0, rows, 0, cols, 0, opts.seed);
+    }
+
+    // With a contact graph the cells are updated in vertex order, `matrix` only shows them
+    Graph graph;
+    Cell *cells = NULL;
+    if (opts.graph_path != NULL)
+    {
+        if (mobility)
         {
-            printf("Error creating main window: %s\n", SDL_GetError());
-            SDL_Quit();
+            fprintf(stderr, "[ERR] The mobility rules need the grid, put long-range contacts in the graph\n");
             return -1;
         }
-
-        rend = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-        if (!rend)
+        if (graph_load(&graph, opts.graph_path, rows, cols, 1) != 0)
+            return -1;
+        cells = grid_alloc(graph.n);
+        if (cells == NULL)
+            return -1;
+        graph_from_grid(&graph, matrix, cells);
+    }
+    // Likewise with a curve layout, `cells` holds the grid in storage order
+    else if (curve)
+    {
+        if (mobility)
         {
-            printf("Error creating renderer: %s\n", SDL_GetError());
-            SDL_DestroyWindow(window);
-            SDL_Quit();
+            fprintf(stderr, "[ERR] The mobility rules need the row-major grid, --layout=rows\n");
             return -1;
         }
+        cells = grid_alloc(n_cells);
+        if (cells == NULL)
+            return -1;
+        layout_pack(&layout, matrix, cells);
     }
 
-    // Init random number generation
-    srand(MY_RANDOM_SEED);
-
-    Cell *matrix = malloc((size_t)(cols * rows) * sizeof(Cell));
-    Cell *upd_matrix = malloc((size_t)(cols * rows) * sizeof(Cell));
-    Cell *buff_neighbors[8];
+    PERF_INIT(1);
+    PERF_THREAD_OPEN(0);
 
-    init_cell_matrix(matrix, cols, rows);
-
-    Uint32 sim_speed = 0;
-    if (use_gui)
-        sim_speed = 10;
-    for (int sim_t = 0; sim_t < SIM_LIMIT; sim_t++)
+    for (int sim_t = 0; sim_t < opts.steps; sim_t++)
     {
         if (use_gui)
         {
-            // Handle events
-            SDL_Event event;
-            while (SDL_PollEvent(&event))
-            {
-                switch (event.type)
-                {
-                case SDL_QUIT:
-                    sim_t = SIM_LIMIT;
-                    break;
-                case SDL_KEYDOWN:
-                    if (event.key.keysym.scancode == SDL_SCANCODE_RIGHTBRACKET)
-                        sim_speed = MIN(MAX_SPEED, sim_speed + 1);
-                    if (event.key.keysym.scancode == SDL_SCANCODE_LEFTBRACKET)
-                        sim_speed = MAX(sim_speed - 1, 1);
-                    if (event.key.keysym.scancode == SDL_SCANCODE_Q)
-                        sim_t = SIM_LIMIT;
-                default:
-                    break;
-                }
-            }
+            if (!gui_poll(&gui))
+                break;
 
-            // Rendering
-            SDL_Rect rect = {.w = CELL_SIZE, .h = CELL_SIZE};
-            SDL_RenderClear(rend);
-            for (int i = 0; i < rows; i++)
-            {
-                for (int j = 0; j < cols; j++)
-                {
-                    CellStatus current_status = matrix[i * cols + j].status;
-                    rect.x = j * CELL_SIZE;
-                    rect.y = i * CELL_SIZE;
-
-                    SDL_SetRenderDrawColor(rend,
-                                           (current_status >> 16) & 0xFF,
-                                           (current_status >> 8) & 0xFF,
-                                           current_status & 0xFF,
-                                           255);
-                    SDL_RenderFillRect(rend, &rect);
-                }
-            }
-            SDL_RenderPresent(rend);
+            PERF_BEGIN(0, PHASE_RENDER);
+            gui_render(&gui, matrix, cols, rows);
+            PERF_END(0, PHASE_RENDER);
         }
 
         // Update
-        memcpy(upd_matrix, matrix, (size_t)(cols * rows) * sizeof(Cell));
-        for (int i = 0; i < rows; i++)
+        PERF_BEGIN(0, PHASE_UPDATE);
+        if (mobility)
+            mobility_merge(&mob);
+        if (opts.graph_path != NULL)
+        {
+            graph_update(&graph, cells, upd_matrix, 0, graph.n, sim_t, opts.seed);
+            void *temp = cells;
+            cells = upd_matrix;
+            upd_matrix = temp;
+            if (trace != NULL || use_gui)
+                graph_to_grid(&graph, cells, matrix);
+        }
+        else if (curve)
+        {
+            for (uint32_t s = 0; s < layout.n_tiles; s++)
+                layout_update_tile(&layout, kernel, cells, upd_matrix, s, sim_t, opts.seed);
+            for (uint32_t s = 0; s < layout.n_tiles; s++)
+                layout_fill_ghosts(&layout, upd_matrix, s);
+            void *temp = cells;
+            cells = upd_matrix;
+            upd_matrix = temp;
+            if (trace != NULL || use_gui)
+                layout_unpack(&layout, cells, matrix);
+        }
+        else if (opts.rolling)
         {
-            for (int j = 0; j < cols; j++)
+            Cell *above = upd_matrix;
+            Cell *below = &upd_matrix[cols];
+            memcpy(above, &matrix[(size_t)(rows - 1) * (size_t)cols], (size_t)cols * sizeof(Cell));
+            memcpy(below, matrix, (size_t)cols * sizeof(Cell));
+            engine_update_rows_inplace(kernel, matrix, cols, 0, rows, above, below, &upd_matrix[2 * (size_t)cols], sim_t, opts.seed, 0);
+            if (mobility)
+                mobility_contacts(&mob, 0, matrix, cols, rows, 0, rows, 0, cols, sim_t + 1, opts.seed);
+        }
+        else
+        {
+            if (opts.tile_size > 0)
             {
-                Cell *current = &upd_matrix[i * cols + j];
-                if (current->status == SUSC_BLUE)
-                {
-                    neighbors(matrix, cols, rows, j, i, buff_neighbors);
-                    susceptible_to_sick_rule(current, buff_neighbors, sim_t);
-                }
-                if (current->status == SICK_NC_ORANGE)
-                {
-                    sick_to_contagious_rule(current, sim_t);
-                }
-                if (current->status == SICK_C_RED)
-                {
-                    contagious_to_isolated_rule(current, sim_t);
-                }
-                if (is_sick(*current) && (sim_t - current->contagion_t) == 14)
+                tiles_plan(&tiles, sim_t);
+                for (int ti = 0; ti < tiles.tile_rows; ti++)
+                    for (int tj = 0; tj < tiles.tile_cols; tj++)
+                    {
+                        tile_update(&tiles, kernel, matrix, upd_matrix, cols, rows, ti, tj, sim_t, opts.seed, 0);
+                        if (mobility)
+                            tile_contacts(&tiles, &mob, 0, upd_matrix, cols, rows, ti, tj, sim_t + 1, opts.seed);
+                    }
+            }
+            else
+            {
+                for (int i = 0; i < rows; i++)
                 {
-                    live_or_die_rule(current);
+                    engine_update_row(kernel, matrix, upd_matrix, cols, rows, i, sim_t, opts.seed, 0);
+                    if (mobility)
+                        mobility_contacts(&mob, 0, &upd_matrix[(size_t)i * (size_t)cols], cols, rows, i, 1, 0, cols,
+                                          sim_t + 1, opts.seed);
                 }
             }
+
+            void *temp = matrix;
+            matrix = upd_matrix;
+            upd_matrix = temp;
+        }
+        if (mobility)
+        {
+            size_t next = 0;
+            mobility_infect(&mob, &next, matrix, cols, 0, rows, sim_t);
+            if (opts.tile_size > 0)
+                tiles_mark_exposed(&tiles, matrix, cols, mob.exposed.cells, mob.exposed.n, sim_t);
         }
+        PERF_END(0, PHASE_UPDATE);
 
-        void *temp = matrix;
-        matrix = upd_matrix;
-        upd_matrix = temp;
+        if (trace != NULL)
+            trace_step(trace, sim_t + 1, matrix, cols, rows);
 
         // Debugging
-        DEBUG_PRINT("\n\tTime: %d\n\tSpeed: %d\n", sim_t, sim_speed);
+        DEBUG_PRINT("\n\tTime: %d\n", sim_t);
 
         if (use_gui)
-            SDL_Delay(1000 / sim_speed);
+            gui_delay(&gui);
     }
 
     DEBUG_PRINT("Simulation finished!\n");
+    if (opts.tile_size > 0)
+    {
+        DEBUG_PRINT("%.1f%% of the tile steps simulated cell by cell\n",
+                    100.0 * (double)tiles.updated / (double)MAX(tiles.updated + tiles.skipped, 1));
+        tiles_free(&tiles);
+    }
+    if (mobility)
+        mobility_free(&mob);
+    if (opts.graph_path != NULL)
+    {
+        graph_to_grid(&graph, cells, matrix);
+        graph_free(&graph);
+        free(cells);
+    }
+    if (curve)
+    {
+        layout_unpack(&layout, cells, matrix);
+        layout_free(&layout);
+        free(cells);
+    }
+    if (trace != NULL)
+        fclose(trace);
+    if (opts.dump_path != NULL)
+        dump_grid(opts.dump_path, matrix, cols, rows);
+    PERF_REPORT("main", (double)rows * cols * opts.steps, sizeof(Cell));
+    PERF_CLOSE();
 
     // Cleanup
     free(matrix);
     free(upd_matrix);
 
     if (use_gui)
-    {
-        SDL_DestroyRenderer(rend);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-    }
+        gui_destroy(&gui);
 
     return 0;
 }
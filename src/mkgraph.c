@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "simulation.h"
+#include "raster.h"
+#include "graph.h"
+
+/*
+    Writes a contact graph (see src/graph.h) for --graph=FILE. Every cell
+    keeps its 8 neighbors of the torus, as on the grid, and may gain:
+
+    --households=S  links between the cells of each S x S block
+    --work=K        K links from every cell with a job risk to random cells
+                    with a job risk anywhere, needs --population
+
+    --population=FILE is the raster of the run (see src/raster.h): empty
+    cells get no household or work links.
+*/
+
+#define MKGRAPH_USAGE "Usage: %s <rows> <cols> <out> [--population=FILE] [--households=S] [--work=K] [--seed=N]\n"
+
+typedef struct Links
+{
+    uint64_t *keys; // (cell << 32 | neighbor), both directions
+    size_t n;
+    size_t cap;
+} Links;
+
+void links_add(Links *links, uint32_t a, uint32_t b)
+{
+    if (links->n + 2 > links->cap)
+    {
+        links->cap = MAX(2 * links->cap, 1024);
+        links->keys = realloc(links->keys, links->cap * sizeof(uint64_t));
+    }
+    links->keys[links->n++] = (uint64_t)a << 32 | b;
+    links->keys[links->n++] = (uint64_t)b << 32 | a;
+}
+
+static int key_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// The 8 neighbors of the grid engines, in row_neighbors() order
+void moore_neighbors(uint32_t cell, int rows, int cols, uint32_t *out)
+{
+    int i = (int)(cell / (uint32_t)cols);
+    int j = (int)(cell % (uint32_t)cols);
+    int k = 0;
+    for (int di = -1; di <= 1; di++)
+    {
+        for (int dj = -1; dj <= 1; dj++)
+        {
+            if (di == 0 && dj == 0)
+                continue;
+            int ni = (i + di + rows) % rows;
+            int nj = (j + dj + cols) % cols;
+            out[k++] = (uint32_t)ni * (uint32_t)cols + (uint32_t)nj;
+        }
+    }
+}
+
+bool write_le(FILE *f, uint64_t value, int n_bytes)
+{
+    uint8_t bytes[8];
+    for (int b = 0; b < n_bytes; b++)
+        bytes[b] = (uint8_t)(value >> (8 * b));
+    return fwrite(bytes, 1, (size_t)n_bytes, f) == (size_t)n_bytes;
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, MKGRAPH_USAGE, argv[0]);
+        return -1;
+    }
+    int rows = atoi(argv[1]);
+    int cols = atoi(argv[2]);
+    const char *out_path = argv[3];
+    const char *population_path = NULL;
+    int households = 0;
+    int work = 0;
+    unsigned int seed = 31415926;
+    for (int k = 4; k < argc; k++)
+    {
+        if (strncmp(argv[k], "--population=", 13) == 0)
+            population_path = argv[k] + 13;
+        else if (strncmp(argv[k], "--households=", 13) == 0)
+            households = atoi(argv[k] + 13);
+        else if (strncmp(argv[k], "--work=", 7) == 0)
+            work = atoi(argv[k] + 7);
+        else if (strncmp(argv[k], "--seed=", 7) == 0)
+            seed = (unsigned int)strtoul(argv[k] + 7, NULL, 10);
+        else
+        {
+            fprintf(stderr, "[ERR] Unknown option '%s'\n" MKGRAPH_USAGE, argv[k], argv[0]);
+            return -1;
+        }
+    }
+    if (rows < 2 || cols < 2 || (uint64_t)rows * (uint64_t)cols > UINT32_MAX)
+    {
+        fprintf(stderr, "[ERR] At least 2 rows and cols and less than 2^32 cells, got %dx%d\n", rows, cols);
+        return -1;
+    }
+    if (households < 0 || work < 0 || (work > 0 && population_path == NULL))
+    {
+        fprintf(stderr, "[ERR] --households and --work take sizes >= 0, --work needs --population\n");
+        return -1;
+    }
+    uint32_t n = (uint32_t)rows * (uint32_t)cols;
+
+    Cell *cells = NULL;
+    if (population_path != NULL)
+    {
+        cells = malloc((size_t)n * sizeof(Cell));
+        if (raster_load_rows(population_path, cells, rows, cols, 0, rows) != 0)
+            return -1;
+    }
+
+    Links links = {0};
+    for (int bi = 0; households > 2 && bi < rows; bi += households)
+    {
+        for (int bj = 0; bj < cols; bj += households)
+        {
+            // Every pair of occupied cells of the block
+            for (int a = 0; a < households * households; a++)
+            {
+                int ai = bi + a / households, aj = bj + a % households;
+                uint32_t ca = (uint32_t)ai * (uint32_t)cols + (uint32_t)aj;
+                if (ai >= rows || aj >= cols || (cells != NULL && cells[ca].status == EMPTY_WHITE))
+                    continue;
+                for (int b = a + 1; b < households * households; b++)
+                {
+                    int ci = bi + b / households, cj = bj + b % households;
+                    uint32_t cb = (uint32_t)ci * (uint32_t)cols + (uint32_t)cj;
+                    if (ci < rows && cj < cols && (cells == NULL || cells[cb].status != EMPTY_WHITE))
+                        links_add(&links, ca, cb);
+                }
+            }
+        }
+    }
+    if (work > 0)
+    {
+        uint32_t *workers = malloc((size_t)n * sizeof(uint32_t));
+        uint32_t n_workers = 0;
+        for (uint32_t c = 0; c < n; c++)
+        {
+            if (cells[c].status != EMPTY_WHITE && cells[c].risk_job)
+                workers[n_workers++] = c;
+        }
+        srand(seed);
+        for (uint32_t w = 0; n_workers > 1 && w < n_workers; w++)
+        {
+            for (int k = 0; k < work; k++)
+            {
+                uint32_t other = workers[(uint32_t)rand() % n_workers];
+                if (other != workers[w])
+                    links_add(&links, workers[w], other);
+            }
+        }
+        free(workers);
+    }
+    qsort(links.keys, links.n, sizeof(uint64_t), key_cmp);
+
+    // Links already among the 8 neighbors, or repeated, are dropped
+    uint32_t moore[8];
+    size_t kept = 0;
+    for (size_t k = 0; k < links.n; k++)
+    {
+        uint32_t a = (uint32_t)(links.keys[k] >> 32);
+        uint32_t b = (uint32_t)links.keys[k];
+        if (kept > 0 && links.keys[kept - 1] == links.keys[k])
+            continue;
+        moore_neighbors(a, rows, cols, moore);
+        bool known = false;
+        for (int m = 0; m < 8; m++)
+            known = known || moore[m] == b;
+        if (!known)
+            links.keys[kept++] = links.keys[k];
+    }
+    links.n = kept;
+
+    FILE *out = fopen(out_path, "wb");
+    if (out == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't create contact graph '%s'\n", out_path);
+        return -1;
+    }
+    bool ok = fwrite(GRAPH_MAGIC, 1, 8, out) == 8 && write_le(out, (uint64_t)rows, 4) &&
+              write_le(out, (uint64_t)cols, 4) && write_le(out, 8 * (uint64_t)n + links.n, 8);
+    uint64_t offset = 0;
+    size_t k = 0;
+    for (uint32_t c = 0; c <= n && ok; c++)
+    {
+        ok = write_le(out, offset, 8);
+        offset += 8;
+        for (; k < links.n && (uint32_t)(links.keys[k] >> 32) == c; k++)
+            offset++;
+    }
+    k = 0;
+    for (uint32_t c = 0; c < n && ok; c++)
+    {
+        moore_neighbors(c, rows, cols, moore);
+        for (int m = 0; m < 8 && ok; m++)
+            ok = write_le(out, moore[m], 4);
+        for (; k < links.n && (uint32_t)(links.keys[k] >> 32) == c && ok; k++)
+            ok = write_le(out, (uint32_t)links.keys[k], 4);
+    }
+    if (fclose(out) != 0 || !ok)
+    {
+        fprintf(stderr, "[ERR] Can't write the contact graph\n");
+        return -1;
+    }
+    DEBUG_PRINT("Wrote a graph of %u cells and %zu extra links to %s\n", n, links.n / 2, out_path);
+    free(links.keys);
+    free(cells);
+    return 0;
+}
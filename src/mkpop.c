@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "utils.h"
+#include "simulation.h"
+#include "raster.h"
+
+/*
+    Writes a population raster (see src/raster.h) for --population=FILE.
+    By default the population is the one the backends draw themselves from
+    the same seed. With --density=FILE.pgm the share of occupied cells
+    follows a binary PGM density map (P5, 255 = every cell occupied, 128
+    about half of them), scaled to the grid.
+*/
+
+#define MKPOP_USAGE "Usage: %s <rows> <cols> <out> [--seed=N] [--density=FILE.pgm]\n"
+
+typedef struct Density
+{
+    int w;
+    int h;
+    int max;
+    uint8_t *pixels;
+} Density;
+
+// Reads an 8 bit binary PGM, returns -1 on error
+int density_read(Density *density, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't open density map '%s'\n", path);
+        return -1;
+    }
+    char magic[3] = {0};
+    if (fscanf(f, "%2s", magic) != 1 || strcmp(magic, "P5") != 0)
+    {
+        fprintf(stderr, "[ERR] '%s' is not a binary PGM (P5)\n", path);
+        fclose(f);
+        return -1;
+    }
+    // Width, height and max value, comments may come between them
+    int values[3];
+    for (int k = 0; k < 3; k++)
+    {
+        int c;
+        while ((c = fgetc(f)) == '#' || c == ' ' || c == '\n' || c == '\r' || c == '\t')
+        {
+            if (c == '#')
+                while ((c = fgetc(f)) != '\n' && c != EOF)
+                    ;
+        }
+        ungetc(c, f);
+        if (fscanf(f, "%d", &values[k]) != 1)
+            values[k] = 0;
+    }
+    fgetc(f); // Single whitespace before the pixels
+    density->w = values[0];
+    density->h = values[1];
+    density->max = values[2];
+    if (density->w <= 0 || density->h <= 0 || density->max <= 0 || density->max > 255)
+    {
+        fprintf(stderr, "[ERR] '%s': unsupported PGM header\n", path);
+        fclose(f);
+        return -1;
+    }
+    density->pixels = malloc((size_t)density->w * (size_t)density->h);
+    if (fread(density->pixels, 1, (size_t)density->w * (size_t)density->h, f) != (size_t)density->w * (size_t)density->h)
+    {
+        fprintf(stderr, "[ERR] '%s': truncated PGM\n", path);
+        free(density->pixels);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+// % of occupied cells at (i, j) of a rows x cols grid, nearest pixel
+int density_at(const Density *density, int i, int j, int rows, int cols)
+{
+    int y = (int)((long)i * density->h / rows);
+    int x = (int)((long)j * density->w / cols);
+    return density->pixels[(size_t)y * (size_t)density->w + (size_t)x] * 100 / density->max;
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, MKPOP_USAGE, argv[0]);
+        return -1;
+    }
+    int rows = atoi(argv[1]);
+    int cols = atoi(argv[2]);
+    const char *out_path = argv[3];
+    unsigned int seed = 31415926;
+    const char *density_path = NULL;
+    for (int k = 4; k < argc; k++)
+    {
+        if (strncmp(argv[k], "--seed=", 7) == 0)
+            seed = (unsigned int)strtoul(argv[k] + 7, NULL, 10);
+        else if (strncmp(argv[k], "--density=", 10) == 0)
+            density_path = argv[k] + 10;
+        else
+        {
+            fprintf(stderr, "[ERR] Unknown option '%s'\n" MKPOP_USAGE, argv[k], argv[0]);
+            return -1;
+        }
+    }
+    if (rows < 2 || cols < 2)
+    {
+        fprintf(stderr, "[ERR] At least 2 rows and cols, got %d and %d\n", rows, cols);
+        return -1;
+    }
+
+    Density density;
+    if (density_path != NULL && density_read(&density, density_path) != 0)
+        return -1;
+
+    FILE *out = raster_create(out_path, cols, rows);
+    if (out == NULL)
+        return -1;
+
+    // Same draws as init_cell_matrix(), one row at a time
+    srand(seed);
+    Cell *row = malloc((size_t)cols * sizeof(Cell));
+    int result = 0;
+    for (int i = 0; i < rows && result == 0; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            int occupied = density_path != NULL ? density_at(&density, i, j, rows, cols) : 50;
+            if (rand() % 100 < 100 - occupied)
+                row[j] = (Cell){.status = EMPTY_WHITE};
+            else
+                new_random_alive_cell(&row[j]);
+        }
+        result = raster_write_rows(out, row, cols, 1);
+    }
+    free(row);
+    if (fclose(out) != 0)
+        result = -1;
+    if (density_path != NULL)
+        free(density.pixels);
+    DEBUG_PRINT("Wrote a %dx%d population to %s\n", rows, cols, out_path);
+    return result;
+}
@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+/*
+    Long-range contacts (the mobility_* rules): on top of its 8 neighbors,
+    every contagious cell meets Poisson(mobility_rate) people a day anywhere
+    within mobility_radius cells, at a distance drawn from a power law
+    kernel (weight distance^-mobility_exponent). A contact with a
+    susceptible cell makes it sick with a mobility_infection % chance.
+
+    Contacts are drawn per source cell from (seed, time, cell) on a stream
+    of their own, so the local rules draw the same numbers as without
+    mobility and every decomposition finds the same contacts. A step
+    updates the grid as usual, then infects the exposed cells that are
+    still susceptible: the result only depends on the set of exposed cells,
+    not on the order contacts were found in. Infecting never makes a cell
+    contagious, so the contacts of the next step are drawn from each row
+    as soon as it is updated, while it is still in cache.
+
+    Offsets are sampled in O(1) from an alias table built once over every
+    offset of the disc.
+*/
+
+#define MOBILITY_STREAM 0x6D6F62696C697479ULL // Keeps contact draws off the rule draws
+#define MOBILITY_MAX_CONTACTS 64
+
+// Global indices of exposed cells
+typedef struct Exposures
+{
+    uint64_t *cells;
+    size_t n;
+    size_t cap;
+} Exposures;
+
+typedef struct Mobility
+{
+    int n_offsets;
+    int *dx;
+    int *dy;
+    double *prob; // Alias table over the offsets
+    int *alias;
+    double poisson[MOBILITY_MAX_CONTACTS + 1]; // CDF of the number of contacts
+    int threads;
+    Exposures *found; // Contacts found by each thread, see mobility_merge()
+    Exposures exposed;
+} Mobility;
+
+bool mobility_enabled(void)
+{
+    return rule_params.mobility_rate > 0;
+}
+
+void exposures_push(Exposures *list, uint64_t cell)
+{
+    if (list->n == list->cap)
+    {
+        list->cap = MAX(2 * list->cap, 256);
+        list->cells = realloc(list->cells, list->cap * sizeof(uint64_t));
+    }
+    list->cells[list->n++] = cell;
+}
+
+static int exposures_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts the list and drops repeated cells
+void exposures_sort(Exposures *list)
+{
+    if (list->n == 0)
+        return;
+    qsort(list->cells, list->n, sizeof(uint64_t), exposures_cmp);
+    size_t kept = 1;
+    for (size_t k = 1; k < list->n; k++)
+    {
+        if (list->cells[k] != list->cells[kept - 1])
+            list->cells[kept++] = list->cells[k];
+    }
+    list->n = kept;
+}
+
+/*
+    Vose's alias method: offset k is kept with probability prob[k] and
+    swapped for alias[k] otherwise. `weights` is overwritten.
+*/
+static void mobility_alias_build(Mobility *mob, double *weights)
+{
+    int n = mob->n_offsets;
+    double total = 0;
+    for (int k = 0; k < n; k++)
+        total += weights[k];
+    int *small = malloc((size_t)n * sizeof(int));
+    int *large = malloc((size_t)n * sizeof(int));
+    int n_small = 0, n_large = 0;
+    for (int k = 0; k < n; k++)
+    {
+        weights[k] *= n / total;
+        if (weights[k] < 1)
+            small[n_small++] = k;
+        else
+            large[n_large++] = k;
+    }
+    while (n_small > 0 && n_large > 0)
+    {
+        int s = small[--n_small];
+        int l = large[--n_large];
+        mob->prob[s] = weights[s];
+        mob->alias[s] = l;
+        weights[l] -= 1 - weights[s];
+        if (weights[l] < 1)
+            small[n_small++] = l;
+        else
+            large[n_large++] = l;
+    }
+    // Leftovers only miss 1 by rounding
+    while (n_large > 0)
+        mob->prob[large[--n_large]] = 1;
+    while (n_small > 0)
+        mob->prob[small[--n_small]] = 1;
+    free(small);
+    free(large);
+}
+
+/*
+    Builds the contact kernel from rule_params for `threads` threads
+    collecting contacts. Offsets start past the 8 neighbors, which the
+    rules already cover. Returns -1 if the rules make no kernel.
+*/
+int mobility_init(Mobility *mob, int threads)
+{
+    assert(mob != NULL && threads > 0);
+    int radius = rule_params.mobility_radius;
+    if (radius < 2 || rule_params.mobility_rate > MOBILITY_MAX_CONTACTS / 4)
+    {
+        fprintf(stderr, "[ERR] mobility_radius must be >= 2 and mobility_rate <= %d\n", MOBILITY_MAX_CONTACTS / 4);
+        return -1;
+    }
+    size_t side = 2 * (size_t)radius + 1;
+    mob->dx = malloc(side * side * sizeof(int));
+    mob->dy = malloc(side * side * sizeof(int));
+    mob->prob = malloc(side * side * sizeof(double));
+    mob->alias = malloc(side * side * sizeof(int));
+    double *weights = malloc(side * side * sizeof(double));
+    mob->n_offsets = 0;
+    for (int dy = -radius; dy <= radius; dy++)
+    {
+        for (int dx = -radius; dx <= radius; dx++)
+        {
+            int d2 = dx * dx + dy * dy;
+            if (MAX(abs(dx), abs(dy)) < 2 || d2 > radius * radius)
+                continue;
+            mob->dx[mob->n_offsets] = dx;
+            mob->dy[mob->n_offsets] = dy;
+            weights[mob->n_offsets] = pow((double)d2, -rule_params.mobility_exponent / 2);
+            mob->n_offsets++;
+        }
+    }
+    mobility_alias_build(mob, weights);
+    free(weights);
+
+    // P(k contacts) = P(k - 1) * rate / k
+    double p = exp(-rule_params.mobility_rate);
+    double cdf = p;
+    for (int k = 0; k <= MOBILITY_MAX_CONTACTS; k++)
+    {
+        mob->poisson[k] = k == MOBILITY_MAX_CONTACTS ? 1 : cdf;
+        p *= rule_params.mobility_rate / (k + 1);
+        cdf += p;
+    }
+
+    mob->threads = threads;
+    mob->found = calloc((size_t)threads, sizeof(Exposures));
+    mob->exposed = (Exposures){0};
+    return 0;
+}
+
+void mobility_free(Mobility *mob)
+{
+    free(mob->dx);
+    free(mob->dy);
+    free(mob->prob);
+    free(mob->alias);
+    for (int t = 0; t < mob->threads; t++)
+        free(mob->found[t].cells);
+    free(mob->found);
+    free(mob->exposed.cells);
+}
+
+// Uniform in [0, 1)
+static double mobility_uniform(CellRng *rng)
+{
+    return (double)cell_rand(rng) / 2147483648.0;
+}
+
+/*
+    Draws the contacts of the contagious cells among rows [first_row,
+    first_row + n_rows) and columns [first_col, first_col + n_cols) of an
+    `h` x `w` grid at `time`. `cells` holds the rows, from column 0.
+    Infecting contacts go to the list of `thread`. Rows wrap like the grid.
+*/
+void mobility_contacts(Mobility *mob, int thread, const Cell *cells, int w, int h,
+                       long first_row, int n_rows, int first_col, int n_cols, int time, uint64_t seed)
+{
+    Exposures *found = &mob->found[thread];
+    for (int i = 0; i < n_rows; i++)
+    {
+        long row = first_row + i;
+        for (int j = first_col; j < first_col + n_cols; j++)
+        {
+            if (cells[(size_t)i * (size_t)w + (size_t)j].status != SICK_C_RED)
+                continue;
+            CellRng rng;
+            cell_rng_seed(&rng, seed ^ MOBILITY_STREAM, time, (uint64_t)row * (uint64_t)w + (uint64_t)j);
+            double u = mobility_uniform(&rng);
+            int n = 0;
+            while (u >= mob->poisson[n])
+                n++;
+            for (int c = 0; c < n; c++)
+            {
+                int k = (int)(((uint64_t)cell_rand(&rng) * (uint64_t)mob->n_offsets) >> 31);
+                if (mobility_uniform(&rng) >= mob->prob[k])
+                    k = mob->alias[k];
+                if (cell_rand(&rng) % 100 >= rule_params.mobility_infection)
+                    continue;
+                long ti = ((row + mob->dy[k]) % h + h) % h;
+                long tj = ((j + mob->dx[k]) % w + w) % w;
+                exposures_push(found, (uint64_t)ti * (uint64_t)w + (uint64_t)tj);
+            }
+        }
+    }
+}
+
+// Moves the contacts found by every thread to `exposed`, sorted
+void mobility_merge(Mobility *mob)
+{
+    mob->exposed.n = 0;
+    for (int t = 0; t < mob->threads; t++)
+    {
+        for (size_t k = 0; k < mob->found[t].n; k++)
+            exposures_push(&mob->exposed, mob->found[t].cells[k]);
+        mob->found[t].n = 0;
+    }
+    exposures_sort(&mob->exposed);
+}
+
+/*
+    Infects the exposed cells of rows [first_row, first_row + n_rows),
+    held in `cells`, that are still susceptible after the step at `time`.
+    `exposed` must be sorted, the ones from index `*next` are scanned and
+    `*next` is left past the last one in the rows, so a grid updated band
+    by band can go through them once.
+*/
+void mobility_infect(const Mobility *mob, size_t *next, Cell *cells, int w, long first_row, int n_rows, int time)
+{
+    uint64_t begin = (uint64_t)first_row * (uint64_t)w;
+    uint64_t end = begin + (uint64_t)n_rows * (uint64_t)w;
+    size_t k = *next;
+    while (k < mob->exposed.n && mob->exposed.cells[k] < begin)
+        k++;
+    for (; k < mob->exposed.n && mob->exposed.cells[k] < end; k++)
+    {
+        Cell *target = &cells[mob->exposed.cells[k] - begin];
+        if (target->status == SUSC_BLUE)
+        {
+            target->status = SICK_NC_ORANGE;
+            target->contagion_t = time;
+        }
+    }
+    *next = k;
+}
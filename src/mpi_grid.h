@@ -0,0 +1,897 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <mpi.h>
+
+/*
+    MPI helpers shared by main-mpi.c and main-hyb.c.
+*/
+
+MPI_Datatype MPI_COVID19_CELL;
+
+void register_cell_type(void)
+{
+    int mpi_cell_block_lengths[] = {1, 1, 1, 1, 1, 1, 1};
+    MPI_Aint mpi_cell_displacements[] = {
+        offsetof(Cell, age),
+        offsetof(Cell, risk_disease),
+        offsetof(Cell, risk_job),
+        offsetof(Cell, vaccinated),
+        offsetof(Cell, gender),
+        offsetof(Cell, status),
+        offsetof(Cell, contagion_t)};
+    MPI_Datatype mpi_cell_lengths[] = {
+        MPI_INT,    // age
+        MPI_C_BOOL, // risk_disease
+        MPI_C_BOOL, // risk_job
+        MPI_C_BOOL, // vaccinated
+        MPI_INT,    // gender
+        MPI_INT,    // status
+        MPI_INT     // contagion_t
+    };
+    MPI_Type_create_struct(
+        7, // Number of fields in 'Cell'
+        mpi_cell_block_lengths,
+        mpi_cell_displacements,
+        mpi_cell_lengths,
+        &MPI_COVID19_CELL);
+    MPI_Type_commit(&MPI_COVID19_CELL);
+}
+
+// Cells per message of the chunked transfers, so each count fits an int however many cells move
+#ifndef MPI_CHUNK_CELLS
+#define MPI_CHUNK_CELLS (1 << 26)
+#endif
+
+// Sends `n` cells to `peer`, in messages of MPI_CHUNK_CELLS cells at most
+void mpi_send_cells(const Cell *cells, size_t n, int peer, int tag, MPI_Comm comm)
+{
+    for (size_t k = 0; k < n; k += MPI_CHUNK_CELLS)
+        MPI_Send(&cells[k], (int)MIN(n - k, (size_t)MPI_CHUNK_CELLS), MPI_COVID19_CELL, peer, tag, comm);
+}
+
+// Receives `n` cells sent by mpi_send_cells() from `peer`
+void mpi_recv_cells(Cell *cells, size_t n, int peer, int tag, MPI_Comm comm)
+{
+    for (size_t k = 0; k < n; k += MPI_CHUNK_CELLS)
+        MPI_Recv(&cells[k], (int)MIN(n - k, (size_t)MPI_CHUNK_CELLS), MPI_COVID19_CELL, peer, tag, comm,
+                 MPI_STATUS_IGNORE);
+}
+
+/*
+    Halos and ghosts travel as plain MPI_BYTE buffers holding what changes
+    between steps: the status of each cell as one byte (and its contagion
+    time when the cell is also updated locally). Neighbors never read the
+    demographics, ranks keep their own copy of them.
+*/
+const CellStatus wire_statuses[] = {EMPTY_WHITE, SUSC_BLUE, SICK_NC_ORANGE, SICK_C_RED,
+                                    ISOLATED_YELLOW, CURED_GREEN, DEAD_BLACK};
+
+uint8_t wire_status(CellStatus status)
+{
+    switch (status)
+    {
+    case EMPTY_WHITE:
+        return 0;
+    case SUSC_BLUE:
+        return 1;
+    case SICK_NC_ORANGE:
+        return 2;
+    case SICK_C_RED:
+        return 3;
+    case ISOLATED_YELLOW:
+        return 4;
+    case CURED_GREEN:
+        return 5;
+    case DEAD_BLACK:
+    default:
+        return 6;
+    }
+}
+
+/*
+    Rows owned by one rank. Ranks own consecutive, possibly uneven, runs of
+    rows that stay in place between steps, only the halo rows are exchanged
+    with the ranks above and below (rows wrap around). The first and last
+    `halo` rows of `cells` are the halos, the n_rows in between are owned.
+    `upd` receives the next state when double buffering and is NULL for
+    rolling updates.
+
+    With halos deeper than one row the ranks exchange them once every `halo`
+    steps and recompute the halo rows they still can in between, one row
+    less on each side per step (see slab_update_range()).
+
+    With a `node` communicator the buffers live in a window shared by the
+    ranks of the node (MPI_Win_allocate_shared): ranks read the rows of
+    their on-node neighbors straight from memory after a barrier, only the
+    boundaries between nodes travel as messages.
+
+    The first exchange into new buffers sends whole cells, the next ones
+    only the statuses, and the contagion times with deeper halos, whose
+    rows are also updated (see slab_halo_bytes()).
+*/
+typedef struct Slab
+{
+    int first_row; // Global index of the first owned row
+    int n_rows;
+    int halo;
+    Cell *cells;
+    Cell *upd;
+    MPI_Comm node;         // Ranks sharing memory with this one, MPI_COMM_NULL for private buffers
+    MPI_Win win;           // Window holding the buffers, MPI_WIN_NULL for private buffers
+    bool filled;           // Whether the halos of both buffers hold whole cells
+    uint8_t *wire;         // Packed halos, sent up and down then received from below and above
+    MPI_Datatype row;      // One row of cells, messages count rows so the counts fit an int on any grid
+    MPI_Datatype wire_row; // One row of packed halo
+} Slab;
+
+// Bytes before the buffers in a shared window, holding the rows and halo of the slab
+#define SLAB_HEADER 64
+
+// Splits `rows` as evenly as possible, the first ranks take the remainder
+void partition_even(int rows, int nprocs, int *counts)
+{
+    assert(counts != NULL && rows >= nprocs);
+    for (int r = 0; r < nprocs; r++)
+        counts[r] = rows / nprocs + (r < rows % nprocs);
+}
+
+int partition_first_row(const int *counts, int rank)
+{
+    int first = 0;
+    for (int r = 0; r < rank; r++)
+        first += counts[r];
+    return first;
+}
+
+// Rows of `cells`, halos included
+int slab_height(const Slab *slab)
+{
+    return slab->n_rows + 2 * slab->halo;
+}
+
+// Bytes a halo cell takes on the wire: its status, and its contagion time when halo rows are updated
+size_t slab_halo_bytes(const Slab *slab)
+{
+    return slab->halo > 1 ? 1 + sizeof(int) : 1;
+}
+
+// Makes the rows written by the ranks of the node visible to each other
+void slab_sync_node(const Slab *slab)
+{
+    if (slab->win == MPI_WIN_NULL)
+        return;
+    MPI_Win_sync(slab->win);
+    MPI_Barrier(slab->node);
+    MPI_Win_sync(slab->win);
+}
+
+/*
+    Allocates the buffers for the rows and halo of `slab`, in a window
+    shared with the ranks of `node` unless it is MPI_COMM_NULL, and its row
+    types. Collective over `node`.
+*/
+void slab_alloc_buffers(Slab *slab, int cols, bool double_buffered, MPI_Comm node)
+{
+    size_t bytes = (size_t)slab_height(slab) * (size_t)cols * sizeof(Cell);
+    slab->node = node;
+    slab->win = MPI_WIN_NULL;
+    slab->filled = false;
+    slab->wire = malloc(4 * (size_t)slab->halo * (size_t)cols * (1 + sizeof(int)));
+    MPI_Datatype wire_cell;
+    MPI_Type_contiguous((int)slab_halo_bytes(slab), MPI_BYTE, &wire_cell);
+    MPI_Type_contiguous(cols, wire_cell, &slab->wire_row);
+    MPI_Type_free(&wire_cell);
+    MPI_Type_commit(&slab->wire_row);
+    MPI_Type_contiguous(cols, MPI_COVID19_CELL, &slab->row);
+    MPI_Type_commit(&slab->row);
+    if (node == MPI_COMM_NULL)
+    {
+        slab->cells = malloc(bytes);
+        slab->upd = double_buffered ? malloc(bytes) : NULL;
+        return;
+    }
+
+    // Each rank's part of the window may sit on its own NUMA node
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    char *base;
+    MPI_Win_allocate_shared((MPI_Aint)(SLAB_HEADER + (double_buffered ? 2 : 1) * bytes), 1, info, node, &base, &slab->win);
+    MPI_Info_free(&info);
+    // A passive epoch for the whole run, MPI_Win_sync() needs one
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, slab->win);
+    int *header = (int *)base;
+    header[0] = slab->n_rows;
+    header[1] = slab->halo;
+    slab->cells = (Cell *)(base + SLAB_HEADER);
+    slab->upd = double_buffered ? (Cell *)(base + SLAB_HEADER + bytes) : NULL;
+    // The other ranks read the header
+    slab_sync_node(slab);
+}
+
+void slab_alloc(Slab *slab, const int *counts, int rank, int cols, bool double_buffered, int halo, MPI_Comm node)
+{
+    assert(slab != NULL && halo >= 1 && halo <= counts[rank]);
+    slab->first_row = partition_first_row(counts, rank);
+    slab->n_rows = counts[rank];
+    slab->halo = halo;
+    slab_alloc_buffers(slab, cols, double_buffered, node);
+}
+
+// Collective over the node with shared buffers
+void slab_free(Slab *slab)
+{
+    free(slab->wire);
+    MPI_Type_free(&slab->row);
+    MPI_Type_free(&slab->wire_row);
+    if (slab->win != MPI_WIN_NULL)
+    {
+        MPI_Win_unlock_all(slab->win);
+        MPI_Win_free(&slab->win);
+        return;
+    }
+    free(slab->cells);
+    free(slab->upd);
+}
+
+void slab_swap(Slab *slab)
+{
+    Cell *temp = slab->cells;
+    slab->cells = slab->upd;
+    slab->upd = temp;
+}
+
+// Rank in the node of `rank` of `comm`, MPI_UNDEFINED when it doesn't share memory with this one
+int slab_node_rank(const Slab *slab, int rank, MPI_Comm comm)
+{
+    if (slab->win == MPI_WIN_NULL)
+        return MPI_UNDEFINED;
+    MPI_Group group, node_group;
+    int node_rank;
+    MPI_Comm_group(comm, &group);
+    MPI_Comm_group(slab->node, &node_group);
+    MPI_Group_translate_ranks(group, 1, &rank, node_group, &node_rank);
+    MPI_Group_free(&group);
+    MPI_Group_free(&node_group);
+    return node_rank;
+}
+
+/*
+    Owned rows of `rank` of `comm`, with their count in `n_rows`, when it
+    shares memory with this one, NULL otherwise. Ranks swap their buffers in
+    lockstep, the current one of the peer is at the same place as ours.
+*/
+Cell *slab_peer_owned(const Slab *slab, int rank, int cols, MPI_Comm comm, int *n_rows)
+{
+    int node_rank = slab_node_rank(slab, rank, comm);
+    if (node_rank == MPI_UNDEFINED)
+        return NULL;
+    MPI_Aint size;
+    int disp_unit;
+    char *base;
+    MPI_Win_shared_query(slab->win, node_rank, &size, &disp_unit, &base);
+    const int *header = (const int *)base;
+    size_t bytes = (size_t)(header[0] + 2 * header[1]) * (size_t)cols * sizeof(Cell);
+    bool second = slab->upd != NULL && slab->cells > slab->upd;
+    *n_rows = header[0];
+    return (Cell *)(base + SLAB_HEADER + (second ? bytes : 0)) + (size_t)header[1] * (size_t)cols;
+}
+
+// First owned row
+Cell *slab_owned(const Slab *slab, int cols)
+{
+    return &slab->cells[(size_t)slab->halo * (size_t)cols];
+}
+
+/*
+    Rows of `cells` holding the state at step `sub` of the current exchange
+    period once updated: [*first, *last). Every step loses one valid row on
+    each side, after `halo` steps only the owned rows are left.
+*/
+void slab_update_range(const Slab *slab, int sub, int *first, int *last)
+{
+    assert(sub >= 0 && sub < slab->halo);
+    *first = sub + 1;
+    *last = slab_height(slab) - sub - 1;
+}
+
+/*
+    Row offset to give the engine for row `i` of `cells` so that the cells
+    draw from their global index, halo rows past the edges of the `rows`
+    grid wrap around.
+*/
+long slab_row_offset(const Slab *slab, int i, int rows)
+{
+    long global_row = ((long)slab->first_row - slab->halo + i + rows) % rows;
+    return global_row - i;
+}
+
+/*
+    Regrows the halos of `slab` to `halo` rows, keeping the owned rows. The
+    halos must be exchanged again afterwards. Collective over the node with
+    shared buffers.
+*/
+void slab_set_halo(Slab *slab, int halo, int cols)
+{
+    assert(halo >= 1 && halo <= slab->n_rows);
+    if (halo == slab->halo)
+        return;
+    Slab resized = *slab;
+    resized.halo = halo;
+    slab_alloc_buffers(&resized, cols, slab->upd != NULL, slab->node);
+    memcpy(slab_owned(&resized, cols), slab_owned(slab, cols), (size_t)slab->n_rows * (size_t)cols * sizeof(Cell));
+    slab_free(slab);
+    *slab = resized;
+}
+
+/*
+    Counts and displacements in rows (slab->row) for a v collective rooted
+    at `master`, which fit an int where cells wouldn't. Ranks sharing
+    memory with the master get no rows: it copies them itself. `count` is
+    what this rank sends or receives.
+*/
+void slab_collective_rows(const Slab *slab, const int *counts, int master, MPI_Comm comm,
+                          int *row_counts, int *displacements, int *count)
+{
+    int nprocs, rank;
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+    for (int r = 0; r < nprocs; r++)
+    {
+        row_counts[r] = counts[r];
+        displacements[r] = partition_first_row(counts, r);
+    }
+    bool master_on_node = slab_node_rank(slab, master, comm) != MPI_UNDEFINED;
+    for (int r = 0; r < nprocs && rank == master; r++)
+    {
+        if (slab_node_rank(slab, r, comm) != MPI_UNDEFINED)
+            row_counts[r] = 0;
+    }
+    *count = master_on_node ? 0 : slab->n_rows;
+}
+
+// Copies between the master's `matrix` and the owned rows of the ranks of its node, on the master
+void slab_copy_node(Slab *slab, Cell *matrix, const int *counts, int cols, MPI_Comm comm, bool to_matrix)
+{
+    int nprocs;
+    MPI_Comm_size(comm, &nprocs);
+    for (int r = 0; r < nprocs; r++)
+    {
+        int n_rows;
+        Cell *owned = slab_peer_owned(slab, r, cols, comm, &n_rows);
+        if (owned == NULL)
+            continue;
+        Cell *rows = &matrix[(size_t)partition_first_row(counts, r) * (size_t)cols];
+        size_t bytes = (size_t)n_rows * (size_t)cols * sizeof(Cell);
+        if (to_matrix)
+            memcpy(rows, owned, bytes);
+        else
+            memcpy(owned, rows, bytes);
+    }
+}
+
+// Hands every rank its rows of the master's `matrix`
+void slab_scatter(Slab *slab, Cell *matrix, const int *counts, int cols, int master, MPI_Comm comm)
+{
+    int nprocs, rank, count;
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+    int *row_counts = malloc((size_t)nprocs * sizeof(int));
+    int *displacements = malloc((size_t)nprocs * sizeof(int));
+    slab_collective_rows(slab, counts, master, comm, row_counts, displacements, &count);
+    if (rank == master)
+        slab_copy_node(slab, matrix, counts, cols, comm, false);
+    MPI_Scatterv(matrix, row_counts, displacements, slab->row, slab_owned(slab, cols), count, slab->row, master, comm);
+    slab_sync_node(slab);
+    free(row_counts);
+    free(displacements);
+}
+
+// Collects the owned rows of every rank into the master's `matrix`
+void slab_gather(Slab *slab, Cell *matrix, const int *counts, int cols, int master, MPI_Comm comm)
+{
+    int nprocs, rank, count;
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+    int *row_counts = malloc((size_t)nprocs * sizeof(int));
+    int *displacements = malloc((size_t)nprocs * sizeof(int));
+    slab_collective_rows(slab, counts, master, comm, row_counts, displacements, &count);
+    slab_sync_node(slab);
+    if (rank == master)
+        slab_copy_node(slab, matrix, counts, cols, comm, true);
+    MPI_Gatherv(slab_owned(slab, cols), count, slab->row, matrix, row_counts, displacements, slab->row, master, comm);
+    free(row_counts);
+    free(displacements);
+}
+
+// Packs `n` cells for the wire, statuses first
+void slab_pack_halo(const Slab *slab, const Cell *cells, size_t n, uint8_t *wire)
+{
+    for (size_t k = 0; k < n; k++)
+        wire[k] = wire_status(cells[k].status);
+    for (size_t k = 0; k < n && slab->halo > 1; k++)
+        memcpy(&wire[n + k * sizeof(int)], &cells[k].contagion_t, sizeof(int));
+}
+
+// Updates `n` cells from the wire, keeping the rest of each cell
+void slab_unpack_halo(const Slab *slab, Cell *cells, size_t n, const uint8_t *wire)
+{
+    for (size_t k = 0; k < n; k++)
+        cells[k].status = wire_statuses[wire[k]];
+    for (size_t k = 0; k < n && slab->halo > 1; k++)
+        memcpy(&cells[k].contagion_t, &wire[n + k * sizeof(int)], sizeof(int));
+}
+
+/*
+    Fills the halos with the last rows of the rank above and the first rows
+    of the rank below. Rows of on-node neighbors are copied straight from
+    their buffers, MPI_PROC_NULL drops those from the messages. Whole cells
+    travel until the halos of both buffers have been filled once, packed
+    halos after that. Every rank allocates new buffers at the same time, so
+    both ends of a message agree on its kind.
+*/
+void slab_exchange_halos(Slab *slab, int cols, MPI_Comm comm)
+{
+    int nprocs, rank;
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+    int up = (rank - 1 + nprocs) % nprocs;
+    int down = (rank + 1) % nprocs;
+    size_t halo_cells = (size_t)slab->halo * (size_t)cols;
+    Cell *top_halo = slab->cells;
+    Cell *bottom_halo = &slab->cells[(size_t)(slab->halo + slab->n_rows) * (size_t)cols];
+    Cell *last_rows = &slab->cells[(size_t)slab->n_rows * (size_t)cols];
+
+    slab_sync_node(slab);
+    int up_rows, down_rows;
+    Cell *up_owned = slab_peer_owned(slab, up, cols, comm, &up_rows);
+    Cell *down_owned = slab_peer_owned(slab, down, cols, comm, &down_rows);
+    int up_peer = up_owned == NULL ? up : MPI_PROC_NULL;
+    int down_peer = down_owned == NULL ? down : MPI_PROC_NULL;
+
+    if (slab->filled)
+    {
+        size_t n_bytes = halo_cells * slab_halo_bytes(slab);
+        uint8_t *to_up = slab->wire;
+        uint8_t *to_down = &slab->wire[n_bytes];
+        uint8_t *from_down = &slab->wire[2 * n_bytes];
+        uint8_t *from_up = &slab->wire[3 * n_bytes];
+        if (up_peer != MPI_PROC_NULL)
+            slab_pack_halo(slab, slab_owned(slab, cols), halo_cells, to_up);
+        if (down_peer != MPI_PROC_NULL)
+            slab_pack_halo(slab, last_rows, halo_cells, to_down);
+        MPI_Sendrecv(to_up, slab->halo, slab->wire_row, up_peer, 0, from_down, slab->halo, slab->wire_row, down_peer, 0,
+                     comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv(to_down, slab->halo, slab->wire_row, down_peer, 1, from_up, slab->halo, slab->wire_row, up_peer, 1,
+                     comm, MPI_STATUS_IGNORE);
+        if (down_peer != MPI_PROC_NULL)
+            slab_unpack_halo(slab, bottom_halo, halo_cells, from_down);
+        if (up_peer != MPI_PROC_NULL)
+            slab_unpack_halo(slab, top_halo, halo_cells, from_up);
+    }
+    else
+    {
+        MPI_Sendrecv(slab_owned(slab, cols), slab->halo, slab->row, up_peer, 0,
+                     bottom_halo, slab->halo, slab->row, down_peer, 0,
+                     comm, MPI_STATUS_IGNORE);
+        MPI_Sendrecv(last_rows, slab->halo, slab->row, down_peer, 1,
+                     top_halo, slab->halo, slab->row, up_peer, 1,
+                     comm, MPI_STATUS_IGNORE);
+    }
+    if (up_owned != NULL)
+        memcpy(top_halo, &up_owned[(size_t)(up_rows - slab->halo) * (size_t)cols], halo_cells * sizeof(Cell));
+    if (down_owned != NULL)
+        memcpy(bottom_halo, down_owned, halo_cells * sizeof(Cell));
+    // The halos of `upd` are only partly written by updates, they get their cells here
+    if (!slab->filled && slab->upd != NULL)
+    {
+        memcpy(slab->upd, top_halo, halo_cells * sizeof(Cell));
+        memcpy(&slab->upd[(size_t)(slab->halo + slab->n_rows) * (size_t)cols], bottom_halo, halo_cells * sizeof(Cell));
+    }
+    slab->filled = true;
+    // Unless they double buffer one-row halos, neighbors overwrite these rows before the next exchange
+    if (slab->upd == NULL || slab->halo > 1)
+        slab_sync_node(slab);
+}
+
+/*
+    Picks the halo depth of `slab` from the latency of an exchange, timed
+    here back to back after a barrier, and `row`, the time this rank takes
+    to update one row. Both are averaged over the ranks. With depth k a
+    step costs one exchange every k steps plus the update of k - 1 rows on
+    top of the owned ones, the depth with the lowest cost is returned. It is
+    capped at `max_halo` and at the rows of every rank. Collective.
+*/
+int slab_tune_halo(Slab *slab, double row, const int *counts, int cols, int max_halo, MPI_Comm comm)
+{
+    int nprocs;
+    MPI_Comm_size(comm, &nprocs);
+    const int reps = 8;
+    MPI_Barrier(comm);
+    double start = MPI_Wtime();
+    for (int k = 0; k < reps; k++)
+        slab_exchange_halos(slab, cols, comm);
+    double times[2] = {(MPI_Wtime() - start) / reps, row};
+    MPI_Allreduce(MPI_IN_PLACE, times, 2, MPI_DOUBLE, MPI_SUM, comm);
+
+    for (int r = 0; r < nprocs; r++)
+        max_halo = MIN(max_halo, counts[r]);
+    int best = 1;
+    for (int k = 2; k <= max_halo; k++)
+    {
+        if (times[0] / k + times[1] * (k - 1) < times[0] / best + times[1] * (best - 1))
+            best = k;
+    }
+    return best;
+}
+
+/*
+    Moves the slab boundaries towards equal update times. `busy` is the
+    time this rank spent updating since the last call. When the slowest rank
+    is more than `threshold` times the mean, each rank is given rows in
+    proportion to its measured rows per second. Rows only move to the
+    neighbor across a boundary and a rank gives away at most half of the
+    rows it has beyond its halo depth per side, so every rank keeps enough
+    rows to fill the halos of its neighbors. Every rank computes the same
+    new `counts` from the gathered times. Returns whether rows moved. The
+    halos must be exchanged again afterwards.
+*/
+bool slab_rebalance(Slab *slab, int *counts, double busy, double threshold, int cols, MPI_Comm comm)
+{
+    int nprocs, rank;
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+    if (nprocs == 1)
+        return false;
+
+    double *times = malloc((size_t)nprocs * sizeof(double));
+    int *shifts = malloc((size_t)nprocs * sizeof(int)); // Of the boundary below each rank
+    MPI_Allgather(&busy, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, comm);
+
+    double mean = 0, slowest = 0, total_speed = 0;
+    int rows = 0;
+    for (int r = 0; r < nprocs; r++)
+    {
+        mean += times[r] / nprocs;
+        slowest = MAX(slowest, times[r]);
+        total_speed += counts[r] / MAX(times[r], 1e-9);
+        rows += counts[r];
+    }
+
+    bool moved = false;
+    double target_end = 0;
+    int end = 0;
+    for (int r = 0; r < nprocs - 1; r++)
+    {
+        target_end += rows * (counts[r] / MAX(times[r], 1e-9)) / total_speed;
+        end += counts[r];
+        int shift = 0;
+        if (slowest > threshold * mean)
+        {
+            shift = (int)(target_end + 0.5) - end;
+            shift = MAX(shift, -(counts[r] - slab->halo) / 2);
+            shift = MIN(shift, (counts[r + 1] - slab->halo) / 2);
+        }
+        shifts[r] = shift;
+        moved = moved || shift != 0;
+    }
+    shifts[nprocs - 1] = 0; // Row 0 stays on rank 0
+    free(times);
+    if (!moved)
+    {
+        free(shifts);
+        return false;
+    }
+
+    // Positive shifts move a boundary down: the upper rank takes rows from the lower one
+    int top = rank > 0 ? shifts[rank - 1] : 0;
+    int bottom = shifts[rank];
+    Slab moved_slab;
+    moved_slab.first_row = slab->first_row + top;
+    moved_slab.n_rows = slab->n_rows - top + bottom;
+    moved_slab.halo = slab->halo;
+    slab_alloc_buffers(&moved_slab, cols, slab->upd != NULL, slab->node);
+    Cell *owned = slab_owned(slab, cols);
+    Cell *moved_owned = slab_owned(&moved_slab, cols);
+
+    // Rows that stay
+    int keep_from = MAX(top, 0);
+    int keep_to = slab->n_rows + MIN(bottom, 0);
+    memcpy(&moved_owned[(size_t)(keep_from - top) * (size_t)cols], &owned[(size_t)keep_from * (size_t)cols],
+           (size_t)(keep_to - keep_from) * (size_t)cols * sizeof(Cell));
+
+    MPI_Request requests[2];
+    int n_requests = 0;
+    if (top < 0)
+        MPI_Irecv(moved_owned, -top, slab->row, rank - 1, 2, comm, &requests[n_requests++]);
+    else if (top > 0)
+        MPI_Isend(owned, top, slab->row, rank - 1, 2, comm, &requests[n_requests++]);
+    if (bottom > 0)
+        MPI_Irecv(&moved_owned[(size_t)(moved_slab.n_rows - bottom) * (size_t)cols], bottom, slab->row,
+                  rank + 1, 2, comm, &requests[n_requests++]);
+    else if (bottom < 0)
+        MPI_Isend(&owned[(size_t)(slab->n_rows + bottom) * (size_t)cols], -bottom, slab->row,
+                  rank + 1, 2, comm, &requests[n_requests++]);
+    MPI_Waitall(n_requests, requests, MPI_STATUSES_IGNORE);
+
+    for (int r = 0; r < nprocs; r++)
+        counts[r] += shifts[r] - (r > 0 ? shifts[r - 1] : 0);
+    free(shifts);
+    slab_free(slab);
+    *slab = moved_slab;
+    return true;
+}
+
+/*
+    Hands the exposed cells found by this rank (see mobility.h) to the
+    ranks owning them, in one all-to-all for the whole step. Afterwards
+    `mob->exposed` holds the sorted exposed cells of this rank's rows.
+*/
+void slab_exchange_contacts(Mobility *mob, const int *counts, int cols, MPI_Comm comm)
+{
+    int nprocs;
+    MPI_Comm_size(comm, &nprocs);
+    int *send_counts = calloc((size_t)nprocs, sizeof(int));
+    int *recv_counts = malloc((size_t)nprocs * sizeof(int));
+    int *send_displs = malloc((size_t)nprocs * sizeof(int));
+    int *recv_displs = malloc((size_t)nprocs * sizeof(int));
+
+    // Sorted cells come in rank order, the owner only moves forward
+    int owner = 0;
+    uint64_t owner_end = (uint64_t)counts[0] * (uint64_t)cols;
+    for (size_t k = 0; k < mob->exposed.n; k++)
+    {
+        while (mob->exposed.cells[k] >= owner_end)
+            owner_end += (uint64_t)counts[++owner] * (uint64_t)cols;
+        send_counts[owner]++;
+    }
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    int received = 0;
+    for (int r = 0; r < nprocs; r++)
+    {
+        send_displs[r] = r == 0 ? 0 : send_displs[r - 1] + send_counts[r - 1];
+        recv_displs[r] = received;
+        received += recv_counts[r];
+    }
+
+    Exposures mine = {.n = (size_t)received, .cap = (size_t)MAX(received, 1)};
+    mine.cells = malloc(mine.cap * sizeof(uint64_t));
+    MPI_Alltoallv(mob->exposed.cells, send_counts, send_displs, MPI_UINT64_T,
+                  mine.cells, recv_counts, recv_displs, MPI_UINT64_T, comm);
+    free(mob->exposed.cells);
+    mob->exposed = mine;
+    exposures_sort(&mob->exposed);
+
+    free(send_counts);
+    free(recv_counts);
+    free(send_displs);
+    free(recv_displs);
+}
+
+/*
+    Contact graph engine (--graph, see graph.h): every rank owns a
+    contiguous range of vertices, in its buffers after them come the
+    ghosts, the vertices of other ranks that its own ones meet. Ghosts are
+    refreshed every step with one all-to-all, in place of the row halos.
+    Every rank loads the whole graph, so it can tell which of its vertices
+    the others need without asking them.
+*/
+typedef struct GraphPart
+{
+    Graph local;       // Owned vertices, neighbors indexing `cells`
+    uint32_t first;    // First owned vertex
+    uint32_t n_owned;
+    uint32_t n_ghosts; // In vertex order, after the owned ones
+    Cell *cells;
+    Cell *upd;
+    uint32_t *send;    // Owned vertices to send, by rank
+    uint8_t *send_buf; // Their statuses, see wire_status()
+    uint8_t *recv_buf; // Statuses of the ghosts
+    int *send_counts;
+    int *send_displs;
+    int *recv_counts;
+    int *recv_displs;
+    uint32_t *bounds;  // First vertex of every rank, then the number of vertices
+    Cell *all;         // Master: every cell in vertex order, for gathers
+} GraphPart;
+
+static int graph_part_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts `list` and drops repeated vertices, returns their number
+static uint32_t graph_part_unique(uint32_t *list, uint32_t n)
+{
+    qsort(list, n, sizeof(uint32_t), graph_part_cmp);
+    uint32_t kept = 0;
+    for (uint32_t k = 0; k < n; k++)
+    {
+        if (kept == 0 || list[kept - 1] != list[k])
+            list[kept++] = list[k];
+    }
+    return kept;
+}
+
+void graph_part_init(GraphPart *part, const Graph *graph, MPI_Comm comm)
+{
+    int nprocs, rank;
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+    uint32_t *bounds = malloc(((size_t)nprocs + 1) * sizeof(uint32_t));
+    graph_partition(graph, nprocs, bounds);
+    uint32_t first = bounds[rank];
+    uint32_t end = bounds[rank + 1];
+    part->first = first;
+    part->n_owned = end - first;
+    part->bounds = bounds;
+
+    // Ghosts: neighbors of owned vertices owned elsewhere, sorted so they come by rank
+    uint64_t n_entries = graph->offsets[end] - graph->offsets[first];
+    uint32_t *ghosts = malloc((size_t)MAX(n_entries, 1) * sizeof(uint32_t));
+    uint32_t n_ghosts = 0;
+    for (uint64_t e = graph->offsets[first]; e < graph->offsets[end]; e++)
+    {
+        if (graph->edges[e] < first || graph->edges[e] >= end)
+            ghosts[n_ghosts++] = graph->edges[e];
+    }
+    n_ghosts = graph_part_unique(ghosts, n_ghosts);
+    part->n_ghosts = n_ghosts;
+    part->recv_counts = calloc((size_t)nprocs, sizeof(int));
+    part->recv_displs = malloc((size_t)nprocs * sizeof(int));
+    for (int r = 0, g = 0; r < nprocs; r++)
+    {
+        part->recv_displs[r] = g;
+        while ((uint32_t)g < n_ghosts && ghosts[g] < bounds[r + 1])
+        {
+            part->recv_counts[r]++;
+            g++;
+        }
+    }
+
+    // Local graph, ghosts are found by bisection in their sorted list
+    part->local.n = part->n_owned;
+    part->local.offsets = malloc(((size_t)part->n_owned + 1) * sizeof(uint64_t));
+    part->local.edges = malloc((size_t)MAX(n_entries, 1) * sizeof(uint32_t));
+    part->local.order = malloc((size_t)MAX(part->n_owned, 1) * sizeof(uint32_t));
+    for (uint32_t k = 0; k <= part->n_owned; k++)
+        part->local.offsets[k] = graph->offsets[first + k] - graph->offsets[first];
+    for (uint32_t k = 0; k < part->n_owned; k++)
+        part->local.order[k] = graph->order[first + k];
+    for (uint64_t e = 0; e < n_entries; e++)
+    {
+        uint32_t v = graph->edges[graph->offsets[first] + e];
+        if (v >= first && v < end)
+            part->local.edges[e] = v - first;
+        else
+        {
+            uint32_t *found = bsearch(&v, ghosts, n_ghosts, sizeof(uint32_t), graph_part_cmp);
+            part->local.edges[e] = part->n_owned + (uint32_t)(found - ghosts);
+        }
+    }
+    free(ghosts);
+
+    // What the others need: owned vertices met by theirs, in the order of their ghosts
+    part->send_counts = calloc((size_t)nprocs, sizeof(int));
+    part->send_displs = malloc((size_t)nprocs * sizeof(int));
+    uint32_t *send = NULL;
+    uint32_t n_send = 0;
+    for (int r = 0; r < nprocs; r++)
+    {
+        part->send_displs[r] = (int)n_send;
+        if (r == rank)
+            continue;
+        uint64_t r_entries = graph->offsets[bounds[r + 1]] - graph->offsets[bounds[r]];
+        send = realloc(send, ((size_t)n_send + (size_t)r_entries + 1) * sizeof(uint32_t));
+        uint32_t n_r = 0;
+        for (uint64_t e = graph->offsets[bounds[r]]; e < graph->offsets[bounds[r + 1]]; e++)
+        {
+            if (graph->edges[e] >= first && graph->edges[e] < end)
+                send[n_send + n_r++] = graph->edges[e] - first;
+        }
+        n_r = graph_part_unique(&send[n_send], n_r);
+        part->send_counts[r] = (int)n_r;
+        n_send += n_r;
+    }
+    part->send = send;
+    part->send_buf = malloc((size_t)n_send + 1);
+    part->recv_buf = malloc((size_t)n_ghosts + 1);
+    size_t n_cells = (size_t)part->n_owned + (size_t)n_ghosts;
+    part->cells = malloc(n_cells * sizeof(Cell));
+    part->upd = malloc(n_cells * sizeof(Cell));
+    part->all = NULL;
+    DEBUG_PRINT("Rank %d: %u vertices, %u ghosts, sends %u\n", rank, part->n_owned, n_ghosts, n_send);
+}
+
+void graph_part_free(GraphPart *part)
+{
+    graph_free(&part->local);
+    free(part->cells);
+    free(part->upd);
+    free(part->send);
+    free(part->send_buf);
+    free(part->recv_buf);
+    free(part->send_counts);
+    free(part->send_displs);
+    free(part->recv_counts);
+    free(part->recv_displs);
+    free(part->bounds);
+    free(part->all);
+}
+
+void graph_part_swap(GraphPart *part)
+{
+    Cell *temp = part->cells;
+    part->cells = part->upd;
+    part->upd = temp;
+}
+
+// Refreshes the ghosts from their owners. Only their status is read, the rest of a ghost is left unset.
+void graph_exchange_ghosts(GraphPart *part, MPI_Comm comm)
+{
+    int nprocs;
+    MPI_Comm_size(comm, &nprocs);
+    int n_send = part->send_displs[nprocs - 1] + part->send_counts[nprocs - 1];
+    for (int k = 0; k < n_send; k++)
+        part->send_buf[k] = wire_status(part->cells[part->send[k]].status);
+    MPI_Alltoallv(part->send_buf, part->send_counts, part->send_displs, MPI_BYTE,
+                  part->recv_buf, part->recv_counts, part->recv_displs, MPI_BYTE, comm);
+    Cell *ghosts = &part->cells[part->n_owned];
+    for (uint32_t g = 0; g < part->n_ghosts; g++)
+        ghosts[g].status = wire_statuses[part->recv_buf[g]];
+}
+
+/*
+    Moves the owned vertices of every rank between their buffers and the
+    master's `all`, in chunks (see mpi_send_cells()): vertex offsets past
+    2^31 don't fit the displacements of a v collective.
+*/
+static void graph_part_transfer(GraphPart *part, int master, MPI_Comm comm, bool to_master)
+{
+    int nprocs, rank;
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+    if (rank != master && to_master)
+        mpi_send_cells(part->cells, part->n_owned, master, 3, comm);
+    else if (rank != master)
+        mpi_recv_cells(part->cells, part->n_owned, master, 3, comm);
+    for (int r = 0; r < nprocs && rank == master; r++)
+    {
+        Cell *cells = &part->all[part->bounds[r]];
+        size_t n = part->bounds[r + 1] - part->bounds[r];
+        if (r == master && to_master)
+            memcpy(cells, part->cells, n * sizeof(Cell));
+        else if (r == master)
+            memcpy(part->cells, cells, n * sizeof(Cell));
+        else if (to_master)
+            mpi_recv_cells(cells, n, r, 3, comm);
+        else
+            mpi_send_cells(cells, n, r, 3, comm);
+    }
+}
+
+// Hands every rank its vertices of the master's grid `matrix`
+void graph_part_scatter(GraphPart *part, const Graph *graph, const Cell *matrix, int master, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank == master && part->all == NULL)
+        part->all = malloc((size_t)graph->n * sizeof(Cell));
+    if (rank == master)
+        graph_from_grid(graph, matrix, part->all);
+    graph_part_transfer(part, master, comm, false);
+}
+
+// Collects the owned vertices of every rank into the master's grid `matrix`
+void graph_part_gather(GraphPart *part, const Graph *graph, Cell *matrix, int master, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank == master && part->all == NULL)
+        part->all = malloc((size_t)graph->n * sizeof(Cell));
+    graph_part_transfer(part, master, comm, true);
+    if (rank == master)
+        graph_to_grid(graph, part->all, matrix);
+}
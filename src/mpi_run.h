@@ -0,0 +1,403 @@
+/*
+    The driver shared by the MPI backends: main-mpi runs it with one
+    thread per rank, main-hyb with an OpenMP team of `n_threads` per rank
+    (built with -fopenmp), which splits the rows or vertices of the rank.
+    Each backend sets up its threads and their counters (PERF_INIT) first.
+*/
+
+// Cells (or vertices) a rank updates each step
+double owned_cells(const Options *opts, const GraphPart *part, const Slab *slab, int cols)
+{
+    return opts->graph_path != NULL ? (double)part->n_owned : (double)slab->n_rows * cols;
+}
+
+int mpi_run(int argc, char const *argv[], int n_threads)
+{
+    int nprocs, rank;
+    MPI_Init(NULL, NULL);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    Options opts;
+    if (parse_options(argc, argv, &opts, rank != MASTER_RANK) != 0)
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    int rows = opts.rows;
+    int cols = opts.cols;
+    bool use_gui = opts.use_gui;
+
+    if (rows < nprocs)
+    {
+        if (rank == MASTER_RANK)
+            fprintf(stderr, "[ERR] rows (%d) < nprocs (%d)\n", rows, nprocs);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    // Slabs hold whole rows, the tiles of the shared memory backends aren't implemented here
+    if (opts.tile_size > 0)
+    {
+        if (rank == MASTER_RANK)
+            fprintf(stderr, "[ERR] --tiles is only supported by main and main-omp\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    // Nor the curve layouts, a slab is a block of row-major rows
+    if (opts.layout != NULL && strcmp(opts.layout, "rows") != 0)
+    {
+        if (rank == MASTER_RANK)
+            fprintf(stderr, "[ERR] --layout is only supported by main and main-omp\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    // The slab halos are exchanged every step, ranks never run a step ahead
+    if (opts.sync_neighbors)
+    {
+        if (rank == MASTER_RANK)
+            fprintf(stderr, "[ERR] --sync=neighbors is only supported by main-omp\n");
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+
+    if (opts.rules_path != NULL && load_rules(opts.rules_path, &rule_params) != 0)
+        MPI_Abort(MPI_COMM_WORLD, -1);
+
+    // Halo rows computed ahead would miss the long-range contacts landing in them
+    Mobility mob;
+    bool mobility = mobility_enabled();
+    if (mobility && mobility_init(&mob, n_threads) != 0)
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    if (mobility && opts.halo_depth != 1)
+    {
+        if (rank == MASTER_RANK)
+            DEBUG_PRINT("Long-range contacts need the halos every step, --halo ignored\n");
+        opts.halo_depth = 1;
+    }
+    // A contact graph has its own partition, the slab options don't apply
+    if (opts.graph_path != NULL)
+    {
+        if (mobility)
+        {
+            if (rank == MASTER_RANK)
+                fprintf(stderr, "[ERR] The mobility rules need the grid, put long-range contacts in the graph\n");
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        }
+        opts.halo_depth = 1;
+        opts.balance_every = 0;
+    }
+
+    // Every rank picks its own kernel, nodes may differ
+    KernelKind kernel_kind;
+    if (kernel_select(opts.kernel, cols, &kernel_kind) != 0)
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    RowKernel kernel = kernel_table[kernel_kind];
+    DEBUG_PRINT("Rank %d uses the %s kernel\n", rank, kernel_names[kernel_kind]);
+
+    // SDL Setup
+    Gui gui;
+    if (rank == MASTER_RANK && use_gui && gui_init(&gui) != 0)
+        MPI_Abort(MPI_COMM_WORLD, -1);
+
+    // Init random number generation
+    srand(opts.seed);
+
+    // Uneven row counts per rank, moved by slab_rebalance()
+    int *counts = malloc((size_t)nprocs * sizeof(int));
+    partition_even(rows, nprocs, counts);
+
+    Cell *matrix = NULL; // Whole grid, on the master only
+    FILE *trace = NULL;
+    Slab slab;
+
+    if (rank == MASTER_RANK)
+        DEBUG_PRINT("Starting MPI_COVID19_CELL type registration\n");
+    register_cell_type();
+    if (rank == MASTER_RANK)
+        DEBUG_PRINT("MPI_COVID19_CELL type registered\n");
+
+    if (rank == MASTER_RANK)
+    {
+        // Init the matrix
+        matrix = grid_alloc(grid_cells(cols, rows));
+        if (matrix == NULL)
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        trace = trace_open(opts.trace_path);
+        // With a raster every rank reads its own rows, the master only needs them all to trace, render or
+        // scatter the vertices of a graph
+        if (opts.population_path == NULL)
+            init_cell_matrix(matrix, cols, rows);
+        else if ((trace != NULL || use_gui || opts.graph_path != NULL) && raster_load_rows(opts.population_path, matrix, rows, cols, 0, rows) != 0)
+            MPI_Abort(MPI_COMM_WORLD, -1);
+
+        if (trace != NULL)
+            trace_step(trace, 0, matrix, cols, rows);
+
+        DEBUG_PRINT("Master rank setup dance complete\n");
+    }
+    // The master only needs the whole grid every step to render or trace it
+    int gather_every_step = use_gui || trace != NULL;
+    MPI_Bcast(&gather_every_step, 1, MPI_INT, MASTER_RANK, MPI_COMM_WORLD);
+
+    // Every rank must own enough rows to fill the halos of its neighbors
+    int halo = opts.halo_depth == 0 ? 1 : MIN(opts.halo_depth, rows / nprocs);
+    if (rank == MASTER_RANK && halo < opts.halo_depth)
+        DEBUG_PRINT("Halo depth capped at %d rows\n", halo);
+    MPI_Comm node = MPI_COMM_NULL;
+    if (opts.shared_memory)
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+    Graph graph;
+    GraphPart part;
+    uint32_t *thread_bounds = NULL; // Owned vertices of each thread
+    Cell *scratch = NULL;
+    if (opts.graph_path != NULL)
+    {
+        // Every rank loads the graph and finds the same partition
+        if (graph_load(&graph, opts.graph_path, rows, cols, nprocs) != 0)
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        graph_part_init(&part, &graph, MPI_COMM_WORLD);
+        graph_part_scatter(&part, &graph, matrix, MASTER_RANK, MPI_COMM_WORLD);
+        thread_bounds = malloc(((size_t)n_threads + 1) * sizeof(uint32_t));
+        graph_partition(&part.local, n_threads, thread_bounds);
+    }
+    else
+    {
+        slab_alloc(&slab, counts, rank, cols, !opts.rolling, halo, node);
+        // 4 rows per thread with a team, see engine_update_team_inplace(), 2 without
+        scratch = opts.rolling ? malloc((size_t)n_threads * 4 * (size_t)cols * sizeof(Cell)) : NULL;
+        if (opts.population_path == NULL)
+            slab_scatter(&slab, matrix, counts, cols, MASTER_RANK, MPI_COMM_WORLD);
+        else if (raster_load_rows(opts.population_path, slab_owned(&slab, cols), rows, cols, slab.first_row, slab.n_rows) != 0)
+            MPI_Abort(MPI_COMM_WORLD, -1);
+        // Later steps draw them as rows are updated
+        if (mobility)
+            mobility_contacts(&mob, 0, slab_owned(&slab, cols), cols, rows, slab.first_row, slab.n_rows, 0, cols, 0, opts.seed);
+    }
+
+    // Every rank publishes its own records and counts its own cells
+    Telemetry tel;
+    if (telemetry_open(&tel, opts.telemetry, rank, nprocs, rows, cols, 0) != 0)
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    if (telemetry_due(&tel, 0) && opts.graph_path != NULL)
+        telemetry_count(&tel, part.cells, part.n_owned, 0);
+    else if (telemetry_due(&tel, 0))
+        telemetry_count(&tel, slab_owned(&slab, cols), grid_cells(cols, slab.n_rows), 0);
+
+    double busy = 0;       // Update time since the last repartition
+    double busy_total = 0; // Update time of the whole run
+    int sub = 0;           // Step since the last halo exchange
+    for (int sim_t = 0; sim_t < opts.steps; sim_t++)
+    {
+        int quit = 0;
+
+        // Rendering on master rank
+        if (rank == MASTER_RANK && use_gui)
+        {
+            quit = !gui_poll(&gui);
+
+            PERF_BEGIN(0, PHASE_RENDER);
+            gui_render(&gui, matrix, cols, rows);
+            PERF_END(0, PHASE_RENDER);
+        }
+
+        // Only the rows bordering the neighbor ranks travel, once every slab.halo steps
+        // or the ghost vertices of a graph, every step
+        if (opts.graph_path != NULL)
+        {
+            PERF_BEGIN(0, PHASE_COMM);
+            graph_exchange_ghosts(&part, MPI_COMM_WORLD);
+            PERF_END(0, PHASE_COMM);
+        }
+        else if (sub == 0)
+        {
+            PERF_BEGIN(0, PHASE_COMM);
+            slab_exchange_halos(&slab, cols, MPI_COMM_WORLD);
+            PERF_END(0, PHASE_COMM);
+        }
+        // Contacts drawn by every rank go to the owners of their targets
+        if (mobility)
+        {
+            PERF_BEGIN(0, PHASE_COMM);
+            mobility_merge(&mob);
+            slab_exchange_contacts(&mob, counts, cols, MPI_COMM_WORLD);
+            PERF_END(0, PHASE_COMM);
+        }
+        int first = 0, last = 0;
+        if (opts.graph_path == NULL)
+            slab_update_range(&slab, sub, &first, &last);
+
+        double update_start = MPI_Wtime();
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+#ifdef _OPENMP
+            int tid = omp_get_thread_num(), team = omp_get_num_threads();
+#else
+            int tid = 0, team = 1;
+#endif
+            PERF_BEGIN(tid, PHASE_UPDATE);
+            if (opts.graph_path != NULL)
+            {
+                for (int t = tid; t < n_threads; t += team)
+                    graph_update(&part.local, part.cells, part.upd, thread_bounds[t], thread_bounds[t + 1], sim_t,
+                                 opts.seed);
+            }
+            else if (opts.rolling)
+            {
+                // The halos are one row deep
+#ifdef _OPENMP
+                engine_update_team_inplace(kernel, slab.cells, cols, slab_height(&slab), first, last,
+                                           scratch, sim_t, opts.seed, slab.first_row - 1);
+#else
+                // and already hold the previous state of the bordering rows
+                engine_update_rows_inplace(kernel, slab.cells, cols, first, last, &slab.cells[(size_t)(first - 1) * (size_t)cols],
+                                           &slab.cells[(size_t)last * (size_t)cols], scratch, sim_t, opts.seed, slab.first_row - 1);
+#endif
+                if (mobility)
+                {
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp for nowait
+#endif
+                    for (int i = 0; i < slab.n_rows; i++)
+                        mobility_contacts(&mob, tid, &slab_owned(&slab, cols)[(size_t)i * (size_t)cols], cols, rows,
+                                          slab.first_row + i, 1, 0, cols, sim_t + 1, opts.seed);
+                }
+            }
+            else
+            {
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+                for (int i = first; i < last; i++)
+                {
+                    engine_update_row(kernel, slab.cells, slab.upd, cols, slab_height(&slab), i, sim_t, opts.seed,
+                                      slab_row_offset(&slab, i, rows));
+                    // Only owned rows are updated with mobility
+                    if (mobility)
+                        mobility_contacts(&mob, tid, &slab.upd[(size_t)i * (size_t)cols], cols, rows,
+                                          slab.first_row + i - slab.halo, 1, 0, cols, sim_t + 1, opts.seed);
+                }
+            }
+            PERF_END(tid, PHASE_UPDATE);
+        }
+        double update_time = MPI_Wtime() - update_start;
+        busy += update_time;
+        if (opts.graph_path != NULL)
+            graph_part_swap(&part);
+        else
+        {
+            sub = (sub + 1) % slab.halo;
+            if (!opts.rolling)
+                slab_swap(&slab);
+        }
+        if (mobility)
+        {
+            size_t next = 0;
+            mobility_infect(&mob, &next, slab_owned(&slab, cols), cols, slab.first_row, slab.n_rows, sim_t);
+        }
+
+        if (gather_every_step)
+        {
+            PERF_BEGIN(0, PHASE_COMM);
+            if (opts.graph_path != NULL)
+                graph_part_gather(&part, &graph, matrix, MASTER_RANK, MPI_COMM_WORLD);
+            else
+                slab_gather(&slab, matrix, counts, cols, MASTER_RANK, MPI_COMM_WORLD);
+            PERF_END(0, PHASE_COMM);
+        }
+
+        if (rank == MASTER_RANK)
+        {
+            if (trace != NULL)
+                trace_step(trace, sim_t + 1, matrix, cols, rows);
+
+            // Debugging
+            DEBUG_PRINT("\n\tTime: %d\n", sim_t);
+
+            if (use_gui)
+                gui_delay(&gui);
+        }
+
+        if (opts.halo_depth == 0 && sim_t + 1 == HALO_TUNE_STEPS)
+        {
+            PERF_BEGIN(0, PHASE_COMM);
+            double row_time = (busy_total + busy) / ((double)HALO_TUNE_STEPS * slab.n_rows);
+            slab_set_halo(&slab, slab_tune_halo(&slab, row_time, counts, cols, HALO_MAX, MPI_COMM_WORLD), cols);
+            PERF_END(0, PHASE_COMM);
+            sub = 0;
+            if (rank == MASTER_RANK)
+                DEBUG_PRINT("Halo depth tuned to %d rows\n", slab.halo);
+        }
+
+        if (opts.balance_every > 0 && (sim_t + 1) % opts.balance_every == 0)
+        {
+            PERF_BEGIN(0, PHASE_COMM);
+            if (slab_rebalance(&slab, counts, busy, opts.imbalance, cols, MPI_COMM_WORLD))
+            {
+                sub = 0;
+                if (rank == MASTER_RANK)
+                    DEBUG_PRINT("Repartitioned at step %d, rank 0 has %d rows\n", sim_t + 1, counts[0]);
+            }
+            PERF_END(0, PHASE_COMM);
+            busy_total += busy;
+            busy = 0;
+        }
+
+        if (telemetry_due(&tel, sim_t + 1) && opts.graph_path != NULL)
+            telemetry_count(&tel, part.cells, part.n_owned, sim_t + 1);
+        else if (telemetry_due(&tel, sim_t + 1))
+            telemetry_count(&tel, slab_owned(&slab, cols), grid_cells(cols, slab.n_rows), sim_t + 1);
+        telemetry_publish(&tel, sim_t + 1, (int64_t)(update_time * 1e9));
+
+        if (use_gui)
+        {
+            PERF_BEGIN(0, PHASE_COMM);
+            MPI_Bcast(&quit, 1, MPI_INT, MASTER_RANK, MPI_COMM_WORLD);
+            PERF_END(0, PHASE_COMM);
+            if (quit)
+                break;
+        }
+    }
+    busy_total += busy;
+    telemetry_close(&tel);
+    DEBUG_PRINT("Rank %d: %.0f cells, %.3f ms of update per step\n", rank, owned_cells(&opts, &part, &slab, cols),
+                1e3 * busy_total / MAX(opts.steps, 1));
+
+    if (!gather_every_step && opts.dump_path != NULL && opts.graph_path != NULL)
+        graph_part_gather(&part, &graph, matrix, MASTER_RANK, MPI_COMM_WORLD);
+    else if (!gather_every_step && opts.dump_path != NULL)
+        slab_gather(&slab, matrix, counts, cols, MASTER_RANK, MPI_COMM_WORLD);
+    if (rank == MASTER_RANK)
+    {
+        DEBUG_PRINT("Simulation finished!\n");
+        if (trace != NULL)
+            fclose(trace);
+        if (opts.dump_path != NULL)
+            dump_grid(opts.dump_path, matrix, cols, rows);
+    }
+
+    char perf_label[64];
+    snprintf(perf_label, sizeof(perf_label), "%s rank %d", argv[0], rank);
+    PERF_REPORT(perf_label, owned_cells(&opts, &part, &slab, cols) * opts.steps, sizeof(Cell));
+    PERF_CLOSE();
+
+    // Cleanup
+    free(matrix);
+    free(counts);
+    if (mobility)
+        mobility_free(&mob);
+    free(scratch);
+    if (opts.graph_path != NULL)
+    {
+        graph_part_free(&part);
+        graph_free(&graph);
+        free(thread_bounds);
+    }
+    else
+        slab_free(&slab);
+    if (node != MPI_COMM_NULL)
+        MPI_Comm_free(&node);
+
+    if (rank == MASTER_RANK && use_gui)
+        gui_destroy(&gui);
+
+    MPI_Type_free(&MPI_COVID19_CELL);
+    MPI_Finalize();
+
+    return 0;
+}
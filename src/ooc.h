@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    Grid kept in a memory-mapped file for main-ooc.c, split in bands of
+    `band_rows` rows. Bands are read ahead with madvise() before they are
+    needed, written back with sync_file_range() as soon as they are done and
+    dropped from the mapping after that, so resident memory stays around a
+    few bands whatever the size of the grid.
+*/
+
+#define OOC_BAND_BYTES (32 << 20) // Default band size
+
+typedef struct OocGrid
+{
+    int fd;
+    Cell *cells;
+    int rows;
+    int cols;
+    int band_rows;
+    int n_bands;
+    size_t bytes;
+} OocGrid;
+
+/*
+    Maps a rows x cols grid stored in `path`, created or truncated. With a
+    NULL path the grid lives in an unlinked file under $TMPDIR. `band_rows`
+    of 0 picks bands of about OOC_BAND_BYTES. Returns -1 on error.
+*/
+int ooc_open(OocGrid *grid, const char *path, int rows, int cols, int band_rows)
+{
+    assert(grid != NULL);
+    if (path != NULL)
+    {
+        grid->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+    else
+    {
+        const char *tmp_dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+        char tmp_path[4096];
+        snprintf(tmp_path, sizeof(tmp_path), "%s/covidsim-grid-XXXXXX", tmp_dir);
+        grid->fd = mkstemp(tmp_path);
+        if (grid->fd >= 0)
+            unlink(tmp_path);
+    }
+    if (grid->fd < 0)
+    {
+        perror("[ERR] Can't create the grid file");
+        return -1;
+    }
+
+    grid->rows = rows;
+    grid->cols = cols;
+    grid->bytes = (size_t)rows * (size_t)cols * sizeof(Cell);
+    if (band_rows <= 0)
+        band_rows = (int)MAX((size_t)1, OOC_BAND_BYTES / ((size_t)cols * sizeof(Cell)));
+    grid->band_rows = MIN(band_rows, rows);
+    grid->n_bands = (rows + grid->band_rows - 1) / grid->band_rows;
+
+    if (ftruncate(grid->fd, (off_t)grid->bytes) != 0)
+    {
+        perror("[ERR] Can't size the grid file");
+        close(grid->fd);
+        return -1;
+    }
+    grid->cells = mmap(NULL, grid->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, grid->fd, 0);
+    if (grid->cells == MAP_FAILED)
+    {
+        perror("[ERR] Can't map the grid file");
+        close(grid->fd);
+        return -1;
+    }
+    madvise(grid->cells, grid->bytes, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void ooc_close(OocGrid *grid)
+{
+    munmap(grid->cells, grid->bytes);
+    close(grid->fd);
+}
+
+int ooc_band_len(const OocGrid *grid, int band)
+{
+    return MIN(grid->band_rows, grid->rows - band * grid->band_rows);
+}
+
+Cell *ooc_band(const OocGrid *grid, int band)
+{
+    return &grid->cells[(size_t)band * (size_t)grid->band_rows * (size_t)grid->cols];
+}
+
+size_t ooc_band_bytes(const OocGrid *grid, int band)
+{
+    return (size_t)ooc_band_len(grid, band) * (size_t)grid->cols * sizeof(Cell);
+}
+
+// madvise() wants page aligned ranges, widen the band to whole pages
+void ooc_band_pages(const OocGrid *grid, int band, char **start, size_t *len)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char *first = (char *)ooc_band(grid, band);
+    char *aligned = (char *)((uintptr_t)first & ~(uintptr_t)(page - 1));
+    *start = aligned;
+    *len = (size_t)(first - aligned) + ooc_band_bytes(grid, band);
+}
+
+// Starts reading `band` in the background
+void ooc_prefetch(const OocGrid *grid, int band)
+{
+    char *start;
+    size_t len;
+    ooc_band_pages(grid, band, &start, &len);
+    madvise(start, len, MADV_WILLNEED);
+}
+
+// Starts writing the dirty pages of `band` back to the file without waiting
+void ooc_writeback(const OocGrid *grid, int band)
+{
+    off_t offset = (off_t)((char *)ooc_band(grid, band) - (char *)grid->cells);
+    sync_file_range(grid->fd, offset, (off_t)ooc_band_bytes(grid, band), SYNC_FILE_RANGE_WRITE);
+}
+
+/*
+    Drops `band` from the mapping once it won't be touched again this step.
+    Dirty pages stay in the page cache until written, nothing is lost.
+*/
+void ooc_release(const OocGrid *grid, int band)
+{
+    char *start;
+    size_t len;
+    ooc_band_pages(grid, band, &start, &len);
+    madvise(start, len, MADV_DONTNEED);
+}
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <limits.h>
+#include <time.h>
+
+#define SIM_LIMIT 120
+#define BALANCE_EVERY 20
+#define BALANCE_THRESHOLD 1.2
+#define HALO_TUNE_STEPS 4 // Steps timed before --halo=auto picks a depth
+#define HALO_MAX 32
+
+#define USAGE "Usage: %s <rows> <cols> <t|f> [--seed=N] [--steps=N] [--trace=FILE] [--dump=FILE]" \
+              " [--kernel=scalar|sse4.2|avx2|avx512|specialized|auto] [--rules=FILE] [--update=double|rolling]" \
+              " [--population=FILE] [--graph=FILE] [--balance=STEPS[:THRESHOLD]] [--halo=DEPTH|auto] [--shm] [--grid=FILE] [--band=ROWS] [--tiles=SIZE]" \
+              " [--layout=rows|morton|hilbert] [--sync=barrier|neighbors] [--telemetry=NAME[:EVERY]]\n"
+
+typedef struct Options
+{
+    int rows;
+    int cols;
+    bool use_gui;
+    unsigned int seed;
+    int steps;
+    const char *trace_path; // Per step hash and status counts
+    const char *dump_path;  // Final grid, one (status, contagion_t) pair per cell
+    const char *kernel;     // NULL picks the fastest kernel the CPU supports
+    const char *rules_path; // Rule spec replacing the default rules
+    const char *population_path; // Raster with the initial population, NULL draws it
+    const char *graph_path; // Contact graph replacing the 8 neighbors, see graph.h
+    bool rolling;           // Update one grid in place instead of double buffering
+    int balance_every;      // MPI: steps between repartitions, 0 keeps the first one
+    double imbalance;       // MPI: slowest / mean update time that triggers one
+    int halo_depth;         // MPI: halo rows, exchanged every halo_depth steps, 0 tunes it
+    bool shared_memory;     // MPI: ranks of a node share their slabs instead of messaging
+    const char *grid_path;  // Out-of-core: file holding the grid, NULL for a temporary one
+    int band_rows;          // Out-of-core: rows per band, 0 picks them from the width
+    int tile_size;          // Hybrid engine: tile side, 0 simulates every cell every step
+    const char *layout;     // Storage order of the grid, NULL for row-major, see layout.h
+    bool sync_neighbors;    // OpenMP: threads wait for the bands next to theirs instead of a barrier
+    const char *telemetry;  // OpenMP, MPI and hybrid: ring of per-step records, see telemetry.h
+} Options;
+
+bool starts_with(const char *s, const char *prefix)
+{
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+// `text` as a number of rows or columns, -1 unless it is a whole number that fits an int
+static int parse_side(const char *text)
+{
+    char *end;
+    long side = strtol(text, &end, 10);
+    return end != text && *end == '\0' && side <= INT_MAX ? (int)side : -1;
+}
+
+/*
+    Parses the command line shared by every backend. Returns 0 on success,
+    -1 on error. Errors are printed unless `quiet` is set, so MPI ranks other
+    than the master can parse silently.
+*/
+int parse_options(int argc, char const *argv[], Options *opts, bool quiet)
+{
+    assert(opts != NULL);
+    if (argc < 4)
+    {
+        if (!quiet)
+            fprintf(stderr, USAGE, argv[0]);
+        return -1;
+    }
+
+    opts->rows = parse_side(argv[1]);
+    opts->cols = parse_side(argv[2]);
+    opts->use_gui = (*argv[3]) == 't';
+    opts->seed =
+#if defined(DEBUG) && DEBUG
+        31415926;
+#else
+        (unsigned int)time(NULL);
+#endif
+    opts->steps = SIM_LIMIT;
+    opts->trace_path = NULL;
+    opts->dump_path = NULL;
+    opts->kernel = NULL;
+    opts->rules_path = NULL;
+    opts->population_path = NULL;
+    opts->graph_path = NULL;
+    opts->rolling = false;
+    opts->balance_every = BALANCE_EVERY;
+    opts->imbalance = BALANCE_THRESHOLD;
+    opts->halo_depth = 1;
+    opts->shared_memory = false;
+    opts->grid_path = NULL;
+    opts->band_rows = 0;
+    opts->tile_size = 0;
+    opts->layout = NULL;
+    opts->sync_neighbors = false;
+    opts->telemetry = NULL;
+
+    for (int i = 4; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (starts_with(arg, "--seed="))
+            opts->seed = (unsigned int)strtoul(arg + strlen("--seed="), NULL, 10);
+        else if (starts_with(arg, "--steps="))
+            opts->steps = atoi(arg + strlen("--steps="));
+        else if (starts_with(arg, "--trace="))
+            opts->trace_path = arg + strlen("--trace=");
+        else if (starts_with(arg, "--dump="))
+            opts->dump_path = arg + strlen("--dump=");
+        else if (starts_with(arg, "--kernel="))
+            opts->kernel = arg + strlen("--kernel=");
+        else if (starts_with(arg, "--rules="))
+            opts->rules_path = arg + strlen("--rules=");
+        else if (starts_with(arg, "--population="))
+            opts->population_path = arg + strlen("--population=");
+        else if (starts_with(arg, "--graph="))
+            opts->graph_path = arg + strlen("--graph=");
+        else if (strcmp(arg, "--update=double") == 0 || strcmp(arg, "--update=rolling") == 0)
+            opts->rolling = strcmp(arg, "--update=rolling") == 0;
+        else if (starts_with(arg, "--grid="))
+            opts->grid_path = arg + strlen("--grid=");
+        else if (starts_with(arg, "--band="))
+            opts->band_rows = atoi(arg + strlen("--band="));
+        else if (starts_with(arg, "--tiles="))
+            opts->tile_size = atoi(arg + strlen("--tiles="));
+        else if (starts_with(arg, "--layout="))
+            opts->layout = arg + strlen("--layout=");
+        else if (strcmp(arg, "--sync=barrier") == 0 || strcmp(arg, "--sync=neighbors") == 0)
+            opts->sync_neighbors = strcmp(arg, "--sync=neighbors") == 0;
+        else if (starts_with(arg, "--telemetry="))
+            opts->telemetry = arg + strlen("--telemetry=");
+        else if (strcmp(arg, "--shm") == 0)
+            opts->shared_memory = true;
+        else if (strcmp(arg, "--halo=auto") == 0)
+            opts->halo_depth = 0;
+        else if (starts_with(arg, "--halo="))
+            opts->halo_depth = atoi(arg + strlen("--halo="));
+        else if (starts_with(arg, "--balance="))
+        {
+            char *threshold;
+            opts->balance_every = (int)strtol(arg + strlen("--balance="), &threshold, 10);
+            if (*threshold == ':')
+                opts->imbalance = strtod(threshold + 1, NULL);
+        }
+        else
+        {
+            if (!quiet)
+                fprintf(stderr, "[ERR] Unknown option '%s'\n" USAGE, arg, argv[0]);
+            return -1;
+        }
+    }
+
+    if (opts->rows < 2 || opts->cols < 2)
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] At least 2 rows and cols and at most %d of each, got '%s' and '%s'\n", INT_MAX, argv[1],
+                    argv[2]);
+        return -1;
+    }
+    if (opts->band_rows < 0)
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] Negative band size: %d\n", opts->band_rows);
+        return -1;
+    }
+    if (opts->tile_size < 0 || (opts->tile_size > 0 && opts->rolling))
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] --tiles takes a SIZE >= 0 and double buffered updates\n");
+        return -1;
+    }
+    if (opts->graph_path != NULL && (opts->rolling || opts->tile_size > 0))
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] --graph takes double buffered updates without --tiles\n");
+        return -1;
+    }
+    if (opts->layout != NULL && strcmp(opts->layout, "rows") != 0 &&
+        (opts->rolling || opts->tile_size > 0 || opts->graph_path != NULL))
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] --layout takes double buffered updates without --tiles or --graph\n");
+        return -1;
+    }
+    // Only the bands next to a thread's are up to date at any time
+    if (opts->sync_neighbors && (opts->rolling || opts->tile_size > 0 || opts->graph_path != NULL ||
+                                 (opts->layout != NULL && strcmp(opts->layout, "rows") != 0) ||
+                                 opts->trace_path != NULL || opts->telemetry != NULL || opts->use_gui))
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] --sync=neighbors takes double buffered row-major updates without --tiles, --graph, --trace, --telemetry or the GUI\n");
+        return -1;
+    }
+    if (opts->halo_depth < 0 || (opts->halo_depth != 1 && opts->rolling))
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] --halo takes a DEPTH >= 1 or auto and double buffered updates\n");
+        return -1;
+    }
+    if (opts->balance_every < 0 || opts->imbalance < 1)
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] --balance takes STEPS >= 0 and a THRESHOLD >= 1\n");
+        return -1;
+    }
+    if (opts->steps < 0)
+    {
+        if (!quiet)
+            fprintf(stderr, "[ERR] Negative number of steps: %d\n", opts->steps);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    Splits `line` on blanks into `argv`, after `program` as the program
+    name, for parse_options(). Keeps at most `max_args` entries. Returns
+    the number of arguments.
+*/
+int split_command_line(char *line, const char *program, char const **argv, int max_args)
+{
+    int argc = 0;
+    argv[argc++] = program;
+    for (char *arg = strtok(line, " \t\r\n"); arg != NULL && argc < max_args; arg = strtok(NULL, " \t\r\n"))
+        argv[argc++] = arg;
+    return argc;
+}
@@ -0,0 +1,293 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+/*
+    Optional hardware counter instrumentation (build with `make PERF=t`).
+
+    Every thread opens its own set of perf_event counters and accumulates
+    them per phase of the step. When the kernel refuses the counters
+    (perf_event_paranoid, containers, VMs without a PMU...) only the wall
+    time of each phase is reported.
+*/
+
+#define PERF_MAX_THREADS 256
+#define PERF_PROBE_BYTES (64UL * 1024 * 1024)
+#define PERF_CACHE_LINE 64
+
+typedef enum PerfPhase
+{
+    PHASE_RENDER = 0,
+    PHASE_COMM = 1,
+    PHASE_COPY = 2,
+    PHASE_UPDATE = 3,
+    PHASE_COUNT = 4
+} PerfPhase;
+
+typedef enum PerfEvent
+{
+    EV_CYCLES = 0,
+    EV_INSTRUCTIONS = 1,
+    EV_LLC_MISSES = 2,
+    EV_BRANCH_MISSES = 3,
+    EV_COUNT = 4
+} PerfEvent;
+
+double perf_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#if defined(PERF_COUNTERS) && PERF_COUNTERS
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Raw read of a counter, see perf_delta()
+typedef struct PerfReading
+{
+    uint64_t value;
+    uint64_t enabled; // ns the counter was enabled
+    uint64_t running; // ns of it the PMU actually counted
+} PerfReading;
+
+typedef struct PerfThread
+{
+    int fds[EV_COUNT];
+    PerfReading start[EV_COUNT];
+    double t_start;
+    uint64_t totals[PHASE_COUNT][EV_COUNT];
+    double seconds[PHASE_COUNT];
+} PerfThread;
+
+typedef struct PerfState
+{
+    int nthreads;
+    bool counters_ok;
+    double peak_bw;
+    PerfThread threads[PERF_MAX_THREADS];
+} PerfState;
+
+PerfState perf_state;
+
+const char *perf_phase_names[PHASE_COUNT] = {"render", "comm", "copy", "update"};
+
+int perf_open_event(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // pid = 0, cpu = -1: count the calling thread on any CPU
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void perf_read_event(int fd, PerfReading *out)
+{
+    uint64_t buf[3]; // value, time enabled, time running
+    if (fd < 0 || read(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+        buf[0] = buf[1] = buf[2] = 0;
+    out->value = buf[0];
+    out->enabled = buf[1];
+    out->running = buf[2];
+}
+
+/*
+    Events counted between readings `r0` and `r1`. When the PMU multiplexed
+    this counter with others, the count is scaled by the share of the
+    interval it ran, from the differences of the three fields: scaling the
+    cumulative values first can make the later one the smaller.
+*/
+uint64_t perf_delta(const PerfReading *r0, const PerfReading *r1)
+{
+    uint64_t value = r1->value - r0->value;
+    uint64_t enabled = r1->enabled - r0->enabled;
+    uint64_t running = r1->running - r0->running;
+    if (running != 0 && running < enabled)
+        return (uint64_t)((double)value * ((double)enabled / (double)running));
+    return value;
+}
+
+double perf_probe_bandwidth(void)
+{
+    // Rough STREAM-like copy, enough to place a roofline ceiling
+    char *a = malloc(PERF_PROBE_BYTES);
+    char *b = malloc(PERF_PROBE_BYTES);
+    if (a == NULL || b == NULL)
+    {
+        free(a);
+        free(b);
+        return 0;
+    }
+    memset(a, 1, PERF_PROBE_BYTES);
+    memset(b, 2, PERF_PROBE_BYTES);
+    double best = 1e30;
+    for (int rep = 0; rep < 5; rep++)
+    {
+        double t0 = perf_now();
+        memcpy(rep % 2 ? a : b, rep % 2 ? b : a, PERF_PROBE_BYTES);
+        double dt = perf_now() - t0;
+        best = MIN(best, dt);
+    }
+    free(a);
+    free(b);
+    // A copy reads and writes every byte once
+    return (2.0 * (double)PERF_PROBE_BYTES) / best;
+}
+
+void perf_init(int nthreads)
+{
+    memset(&perf_state, 0, sizeof(perf_state));
+    perf_state.nthreads = MIN(nthreads, PERF_MAX_THREADS);
+    perf_state.counters_ok = true;
+    perf_state.peak_bw = perf_probe_bandwidth();
+    for (int t = 0; t < PERF_MAX_THREADS; t++)
+        for (int e = 0; e < EV_COUNT; e++)
+            perf_state.threads[t].fds[e] = -1;
+}
+
+void perf_thread_open(int tid)
+{
+    if (tid < 0 || tid >= perf_state.nthreads)
+        return;
+    PerfThread *pt = &perf_state.threads[tid];
+
+    const uint32_t types[EV_COUNT] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+    const uint64_t configs[EV_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES};
+    for (int e = 0; e < EV_COUNT; e++)
+        pt->fds[e] = perf_open_event(types[e], configs[e]);
+
+    if (pt->fds[EV_CYCLES] < 0)
+    {
+        // Every thread fails the same way, only the first one complains
+        if (tid == 0)
+            fprintf(stderr, "[PERF] perf_event_open failed (%s), reporting wall time only. "
+                            "See /proc/sys/kernel/perf_event_paranoid\n",
+                    strerror(errno));
+        perf_state.counters_ok = false;
+    }
+}
+
+void perf_phase_begin(int tid, PerfPhase phase)
+{
+    (void)phase;
+    if (tid < 0 || tid >= perf_state.nthreads)
+        return;
+    PerfThread *pt = &perf_state.threads[tid];
+    for (int e = 0; e < EV_COUNT; e++)
+        perf_read_event(pt->fds[e], &pt->start[e]);
+    pt->t_start = perf_now();
+}
+
+void perf_phase_end(int tid, PerfPhase phase)
+{
+    if (tid < 0 || tid >= perf_state.nthreads)
+        return;
+    PerfThread *pt = &perf_state.threads[tid];
+    pt->seconds[phase] += perf_now() - pt->t_start;
+    for (int e = 0; e < EV_COUNT; e++)
+    {
+        PerfReading end;
+        perf_read_event(pt->fds[e], &end);
+        pt->totals[phase][e] += perf_delta(&pt->start[e], &end);
+    }
+}
+
+/*
+    `cell_updates` is the number of cells updated by this process over the
+    whole run and `cell_bytes` the size of one cell. The roofline ceiling
+    assumes every update streams the old cell in and the new cell out,
+    which is the best the double buffered grid can do.
+*/
+void perf_report(const char *label, double cell_updates, size_t cell_bytes)
+{
+    double min_bytes[PHASE_COUNT] = {
+        (double)cell_bytes,       // render: read the status
+        0,                        // comm: not a memory phase
+        2.0 * (double)cell_bytes, // copy: read + write
+        2.0 * (double)cell_bytes  // update: read old + write new
+    };
+
+    fprintf(stderr, "[PERF] %s: %d thread(s), %.0f cell updates, probed peak %.2f GB/s\n",
+            label, perf_state.nthreads, cell_updates, perf_state.peak_bw * 1e-9);
+    for (int p = 0; p < PHASE_COUNT; p++)
+    {
+        double wall = 0;
+        uint64_t sum[EV_COUNT] = {0};
+        for (int t = 0; t < perf_state.nthreads; t++)
+        {
+            PerfThread *pt = &perf_state.threads[t];
+            wall = MAX(wall, pt->seconds[p]);
+            for (int e = 0; e < EV_COUNT; e++)
+                sum[e] += pt->totals[p][e];
+        }
+        if (wall <= 0)
+            continue;
+
+        fprintf(stderr, "[PERF]   %-7s %10.4f s", perf_phase_names[p], wall);
+        if (perf_state.counters_ok && sum[EV_CYCLES] > 0)
+        {
+            fprintf(stderr, "  IPC %5.2f  LLC-miss/upd %7.4f  br-miss/upd %7.4f  LLC bw %7.2f GB/s",
+                    (double)sum[EV_INSTRUCTIONS] / (double)sum[EV_CYCLES],
+                    (double)sum[EV_LLC_MISSES] / cell_updates,
+                    (double)sum[EV_BRANCH_MISSES] / cell_updates,
+                    (double)sum[EV_LLC_MISSES] * PERF_CACHE_LINE / wall * 1e-9);
+        }
+        if (min_bytes[p] > 0)
+        {
+            double achieved = cell_updates * min_bytes[p] / wall;
+            fprintf(stderr, "  model bw %7.2f GB/s (%5.1f%% of DRAM roofline)",
+                    achieved * 1e-9,
+                    perf_state.peak_bw > 0 ? 100.0 * achieved / perf_state.peak_bw : 0.0);
+        }
+        fprintf(stderr, "\n");
+
+        for (int t = 0; t < perf_state.nthreads && perf_state.nthreads > 1; t++)
+        {
+            PerfThread *pt = &perf_state.threads[t];
+            if (!perf_state.counters_ok || pt->totals[p][EV_CYCLES] == 0)
+                continue;
+            fprintf(stderr, "[PERF]     thread %3d: %10.4f s  IPC %5.2f  LLC-miss %12llu  br-miss %12llu\n",
+                    t, pt->seconds[p],
+                    (double)pt->totals[p][EV_INSTRUCTIONS] / (double)pt->totals[p][EV_CYCLES],
+                    (unsigned long long)pt->totals[p][EV_LLC_MISSES],
+                    (unsigned long long)pt->totals[p][EV_BRANCH_MISSES]);
+        }
+    }
+}
+
+void perf_close(void)
+{
+    for (int t = 0; t < perf_state.nthreads; t++)
+        for (int e = 0; e < EV_COUNT; e++)
+            if (perf_state.threads[t].fds[e] >= 0)
+                close(perf_state.threads[t].fds[e]);
+}
+
+#define PERF_INIT(nthreads) perf_init(nthreads)
+#define PERF_THREAD_OPEN(tid) perf_thread_open(tid)
+#define PERF_BEGIN(tid, phase) perf_phase_begin(tid, phase)
+#define PERF_END(tid, phase) perf_phase_end(tid, phase)
+#define PERF_REPORT(label, updates, cell_bytes) perf_report(label, updates, cell_bytes)
+#define PERF_CLOSE() perf_close()
+#else
+#define PERF_INIT(nthreads)
+#define PERF_THREAD_OPEN(tid)
+#define PERF_BEGIN(tid, phase)
+#define PERF_END(tid, phase)
+#define PERF_REPORT(label, updates, cell_bytes)
+#define PERF_CLOSE()
+#endif
@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+    Grid buffers kept by the daemon between jobs (see src/daemon.c). A
+    buffer of n cells comes from size class ceil(log2(n)) and goes back to
+    the free list of its class when the job ends, so back to back jobs of
+    similar sizes get memory that is already mapped and paged in instead of
+    allocating it again. A class keeps at most POOL_KEEP free buffers,
+    enough for the two grids of a job and the next one.
+*/
+
+#define POOL_CLASSES 48
+#define POOL_KEEP 4
+
+typedef struct GridPool
+{
+    Cell *free[POOL_CLASSES][POOL_KEEP];
+    int n_free[POOL_CLASSES];
+    size_t reused; // Buffers handed out again
+    size_t allocated;
+} GridPool;
+
+void pool_init(GridPool *pool)
+{
+    for (int c = 0; c < POOL_CLASSES; c++)
+        pool->n_free[c] = 0;
+    pool->reused = 0;
+    pool->allocated = 0;
+}
+
+// Smallest class holding `n_cells`
+int pool_class(size_t n_cells)
+{
+    int c = 0;
+    while (c < POOL_CLASSES - 1 && ((size_t)1 << c) < n_cells)
+        c++;
+    return c;
+}
+
+// A buffer of at least `n_cells` cells, NULL if it can't be allocated
+Cell *pool_get(GridPool *pool, size_t n_cells)
+{
+    int c = pool_class(n_cells);
+    if (pool->n_free[c] > 0)
+    {
+        pool->reused++;
+        return pool->free[c][--pool->n_free[c]];
+    }
+    pool->allocated++;
+    return malloc(((size_t)1 << c) * sizeof(Cell));
+}
+
+// Hands back a buffer from pool_get() for `n_cells`
+void pool_put(GridPool *pool, Cell *cells, size_t n_cells)
+{
+    int c = pool_class(n_cells);
+    if (cells == NULL)
+        return;
+    if (pool->n_free[c] == POOL_KEEP)
+        free(cells);
+    else
+        pool->free[c][pool->n_free[c]++] = cells;
+}
+
+void pool_free(GridPool *pool)
+{
+    for (int c = 0; c < POOL_CLASSES; c++)
+    {
+        while (pool->n_free[c] > 0)
+            free(pool->free[c][--pool->n_free[c]]);
+    }
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    Population raster (--population=FILE): the initial grid stored as one
+    byte per cell after a 16 byte header, so any backend can map it and
+    decode just the rows it owns instead of drawing the population with
+    rand(). Header: the magic "COVIDPOP" then rows and cols as little
+    endian uint32. Cell bits:
+
+        0-1  age (CHILD, ADULT, ELDER)
+        2    risk_disease
+        3    risk_job
+        4    vaccinated
+        5    gender
+        6-7  status: 0 empty, 1 susceptible, 2 sick (not contagious yet)
+
+    build/mkpop writes rasters, from the same synthetic population as the
+    default init or from a density map.
+*/
+
+#define RASTER_MAGIC "COVIDPOP"
+#define RASTER_HEADER 16
+
+typedef struct Raster
+{
+    int fd;
+    uint8_t *map;
+    size_t bytes;
+    int rows;
+    int cols;
+} Raster;
+
+uint8_t raster_encode(Cell c)
+{
+    unsigned status = c.status == EMPTY_WHITE ? 0 : (c.status == SUSC_BLUE ? 1 : 2);
+    return (uint8_t)(((unsigned)c.age & 3) | c.risk_disease << 2 | c.risk_job << 3 |
+                     c.vaccinated << 4 | ((unsigned)c.gender & 1) << 5 | status << 6);
+}
+
+void raster_decode(uint8_t byte, Cell *c)
+{
+    static const CellStatus statuses[4] = {EMPTY_WHITE, SUSC_BLUE, SICK_NC_ORANGE, EMPTY_WHITE};
+    c->age = (Age)(byte & 3);
+    c->risk_disease = (byte >> 2) & 1;
+    c->risk_job = (byte >> 3) & 1;
+    c->vaccinated = (byte >> 4) & 1;
+    c->gender = (Gender)((byte >> 5) & 1);
+    c->status = statuses[byte >> 6];
+    c->contagion_t = 0;
+}
+
+/*
+    Maps the raster at `path` read-only, it must hold a `rows` x `cols`
+    grid. Nothing is read until rows are decoded. Returns -1 on error.
+*/
+int raster_open(Raster *raster, const char *path, int rows, int cols)
+{
+    assert(raster != NULL && path != NULL);
+    raster->fd = open(path, O_RDONLY);
+    if (raster->fd < 0)
+    {
+        fprintf(stderr, "[ERR] Can't open population raster '%s'\n", path);
+        return -1;
+    }
+    struct stat st;
+    uint8_t header[RASTER_HEADER];
+    if (fstat(raster->fd, &st) != 0 || st.st_size < RASTER_HEADER ||
+        pread(raster->fd, header, RASTER_HEADER, 0) != RASTER_HEADER ||
+        memcmp(header, RASTER_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "[ERR] '%s' is not a population raster\n", path);
+        close(raster->fd);
+        return -1;
+    }
+    uint32_t dims[2];
+    for (int k = 0; k < 2; k++)
+        dims[k] = (uint32_t)header[8 + 4 * k] | (uint32_t)header[9 + 4 * k] << 8 |
+                  (uint32_t)header[10 + 4 * k] << 16 | (uint32_t)header[11 + 4 * k] << 24;
+    raster->rows = (int)dims[0];
+    raster->cols = (int)dims[1];
+    raster->bytes = RASTER_HEADER + (size_t)raster->rows * (size_t)raster->cols;
+    if (raster->rows != rows || raster->cols != cols || (size_t)st.st_size < raster->bytes)
+    {
+        fprintf(stderr, "[ERR] '%s' holds a %dx%d grid, expected %dx%d\n", path, raster->rows, raster->cols, rows, cols);
+        close(raster->fd);
+        return -1;
+    }
+    raster->map = mmap(NULL, raster->bytes, PROT_READ, MAP_PRIVATE, raster->fd, 0);
+    if (raster->map == MAP_FAILED)
+    {
+        perror("[ERR] Can't map the population raster");
+        close(raster->fd);
+        return -1;
+    }
+    return 0;
+}
+
+void raster_close(Raster *raster)
+{
+    munmap(raster->map, raster->bytes);
+    close(raster->fd);
+}
+
+// Decodes rows [first_row, first_row + n_rows) into `matrix`, only their pages are read
+void raster_read_rows(const Raster *raster, Cell *matrix, long first_row, int n_rows)
+{
+    assert(first_row >= 0 && first_row + n_rows <= raster->rows);
+    size_t cols = (size_t)raster->cols;
+    const uint8_t *cells = &raster->map[RASTER_HEADER + (size_t)first_row * cols];
+    madvise((void *)((uintptr_t)cells & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1)),
+            (size_t)n_rows * cols + ((uintptr_t)cells & (uintptr_t)(sysconf(_SC_PAGESIZE) - 1)), MADV_WILLNEED);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < n_rows; i++)
+    {
+        for (size_t j = 0; j < cols; j++)
+            raster_decode(cells[(size_t)i * cols + j], &matrix[(size_t)i * cols + j]);
+    }
+}
+
+// raster_open(), raster_read_rows() and raster_close() in one go, returns -1 on error
+int raster_load_rows(const char *path, Cell *matrix, int rows, int cols, long first_row, int n_rows)
+{
+    Raster raster;
+    if (raster_open(&raster, path, rows, cols) != 0)
+        return -1;
+    raster_read_rows(&raster, matrix, first_row, n_rows);
+    raster_close(&raster);
+    return 0;
+}
+
+// Creates a raster for a `w` x `h` grid and writes its header, rows follow with raster_write_rows()
+FILE *raster_create(const char *path, int w, int h)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't create population raster '%s'\n", path);
+        return NULL;
+    }
+    uint8_t header[RASTER_HEADER];
+    memcpy(header, RASTER_MAGIC, 8);
+    uint32_t dims[2] = {(uint32_t)h, (uint32_t)w};
+    for (int k = 0; k < 8; k++)
+        header[8 + k] = (uint8_t)(dims[k / 4] >> (8 * (k % 4)));
+    fwrite(header, 1, RASTER_HEADER, f);
+    return f;
+}
+
+// Appends `n_rows` rows of `w` cells, returns -1 on error
+int raster_write_rows(FILE *f, const Cell *cells, int w, int n_rows)
+{
+    uint8_t *row = malloc((size_t)w);
+    int result = 0;
+    for (int i = 0; i < n_rows && result == 0; i++)
+    {
+        for (int j = 0; j < w; j++)
+            row[j] = raster_encode(cells[(size_t)i * (size_t)w + (size_t)j]);
+        if (fwrite(row, 1, (size_t)w, f) != (size_t)w)
+        {
+            fprintf(stderr, "[ERR] Can't write the population raster\n");
+            result = -1;
+        }
+    }
+    free(row);
+    return result;
+}
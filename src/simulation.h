@@ -1,4 +1,7 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
 #define DISSEASE_STRENGTH 2.4
@@ -29,6 +32,143 @@ typedef enum CellStatus
     DEAD_BLACK = 0x000000
 } CellStatus;
 
+/*
+    Disease constants read by the rules. `rule_params` starts with the
+    defaults below and can be replaced from a rule spec (--rules=FILE), see
+    rules/default.rules for the format.
+*/
+typedef struct RuleParams
+{
+    double disease_strength;
+    int susceptibility[3];   // %, by age
+    int risk_susceptibility; // Added with a disease or job risk
+    int contagious_after;    // Days from sick to contagious
+    int isolation_after;     // Days from contagious to isolation
+    int isolation_chance;    // %
+    int resolution_after;    // Days from sick to cured or dead
+    double death_chance[3];  // %, by age
+    double vaccine_protection;
+    double mobility_rate;     // Long-range contacts a day per contagious cell, 0 disables them
+    int mobility_radius;      // Cells, see mobility.h
+    double mobility_exponent; // Contact kernel: distance^-exponent
+    int mobility_infection;   // % of contacts that infect a susceptible cell
+} RuleParams;
+
+#define RULES_DEFAULT                          \
+    {                                          \
+        .disease_strength = DISSEASE_STRENGTH, \
+        .susceptibility = {30, 50, 90},        \
+        .risk_susceptibility = 15,             \
+        .contagious_after = 4,                 \
+        .isolation_after = 2,                  \
+        .isolation_chance = 90,                \
+        .resolution_after = 14,                \
+        .death_chance = {1, 1.3, 14.8},        \
+        .vaccine_protection = 0.5,             \
+        .mobility_rate = 0,                    \
+        .mobility_radius = 30,                 \
+        .mobility_exponent = 2,                \
+        .mobility_infection = 5                \
+    }
+
+RuleParams rule_params = RULES_DEFAULT;
+
+/*
+    Reads a rule spec into `params`: one `key = value` per line, `#` starts
+    a comment and missing keys keep their current value. Returns -1 on an
+    unknown key or a malformed line.
+*/
+int load_rules(const char *path, RuleParams *params)
+{
+    assert(path != NULL && params != NULL);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't open rule spec '%s'\n", path);
+        return -1;
+    }
+
+    char line[256];
+    int line_n = 0;
+    int result = 0;
+    while (result == 0 && fgets(line, sizeof(line), f) != NULL)
+    {
+        line_n++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        char key[64];
+        double value;
+        char extra;
+        int n = sscanf(line, " %63[a-z_] = %lf %c", key, &value, &extra);
+        if (n == EOF)
+            continue; // Blank line
+        if (n != 2)
+        {
+            fprintf(stderr, "[ERR] %s:%d: expected 'key = value'\n", path, line_n);
+            result = -1;
+        }
+        else if (strcmp(key, "disease_strength") == 0)
+            params->disease_strength = value;
+        else if (strcmp(key, "susceptibility_child") == 0)
+            params->susceptibility[CHILD] = (int)value;
+        else if (strcmp(key, "susceptibility_adult") == 0)
+            params->susceptibility[ADULT] = (int)value;
+        else if (strcmp(key, "susceptibility_elder") == 0)
+            params->susceptibility[ELDER] = (int)value;
+        else if (strcmp(key, "risk_susceptibility") == 0)
+            params->risk_susceptibility = (int)value;
+        else if (strcmp(key, "contagious_after") == 0)
+            params->contagious_after = (int)value;
+        else if (strcmp(key, "isolation_after") == 0)
+            params->isolation_after = (int)value;
+        else if (strcmp(key, "isolation_chance") == 0)
+            params->isolation_chance = (int)value;
+        else if (strcmp(key, "resolution_after") == 0)
+            params->resolution_after = (int)value;
+        else if (strcmp(key, "death_chance_child") == 0)
+            params->death_chance[CHILD] = value;
+        else if (strcmp(key, "death_chance_adult") == 0)
+            params->death_chance[ADULT] = value;
+        else if (strcmp(key, "death_chance_elder") == 0)
+            params->death_chance[ELDER] = value;
+        else if (strcmp(key, "vaccine_protection") == 0)
+            params->vaccine_protection = value;
+        else if (strcmp(key, "mobility_rate") == 0)
+            params->mobility_rate = value;
+        else if (strcmp(key, "mobility_radius") == 0)
+            params->mobility_radius = (int)value;
+        else if (strcmp(key, "mobility_exponent") == 0)
+            params->mobility_exponent = value;
+        else if (strcmp(key, "mobility_infection") == 0)
+            params->mobility_infection = (int)value;
+        else
+        {
+            fprintf(stderr, "[ERR] %s:%d: unknown rule '%s'\n", path, line_n, key);
+            result = -1;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+// Compares the rules the kernels apply, the mobility ones run outside them
+bool rules_equal(const RuleParams *a, const RuleParams *b)
+{
+    assert(a != NULL && b != NULL);
+    bool same = a->risk_susceptibility == b->risk_susceptibility &&
+                a->contagious_after == b->contagious_after &&
+                a->isolation_after == b->isolation_after &&
+                a->isolation_chance == b->isolation_chance &&
+                a->resolution_after == b->resolution_after &&
+                memcmp(&a->disease_strength, &b->disease_strength, sizeof(double)) == 0 &&
+                memcmp(&a->vaccine_protection, &b->vaccine_protection, sizeof(double)) == 0;
+    for (int k = 0; k < 3; k++)
+        same = same && a->susceptibility[k] == b->susceptibility[k] &&
+               memcmp(&a->death_chance[k], &b->death_chance[k], sizeof(double)) == 0;
+    return same;
+}
+
 typedef struct Cell
 {
     Age age;
@@ -40,12 +180,46 @@ typedef struct Cell
     int contagion_t;
 } Cell;
 
-void neighbors(Cell *matrix, int matrix_w, int matrix_h, int cell_x, int cell_y, Cell **out_buffer)
+/*
+    Random numbers used by the rules are derived from (seed, time, cell)
+    instead of a shared rand() stream: every backend draws the same numbers
+    for the same cell no matter how rows are split among ranks or threads.
+*/
+typedef struct CellRng
 {
-    assert(matrix != NULL);
+    uint64_t state;
+} CellRng;
+
+uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void cell_rng_seed(CellRng *rng, uint64_t seed, int time, uint64_t pos)
+{
+    assert(rng != NULL);
+    uint64_t by_time = (uint64_t)time;
+    rng->state = seed ^ splitmix64(&by_time) ^ (pos * 0xD6E8FEB86659FD93ULL);
+}
+
+int cell_rand(CellRng *rng)
+{
+    assert(rng != NULL);
+    return (int)(splitmix64(&rng->state) >> 33);
+}
+
+/*
+    Neighbors of the cell at column `cell_x` of `row`, where `above` and
+    `below` are the rows on top and under it. Columns wrap around.
+*/
+void row_neighbors(Cell *above, Cell *row, Cell *below, int cols, int cell_x, Cell **out_buffer)
+{
+    assert(above != NULL && row != NULL && below != NULL);
     assert(out_buffer != NULL);
-    assert(cell_x >= 0);
-    assert(cell_y >= 0);
+    assert(cell_x >= 0 && cell_x < cols);
 
     /*
         C is the current Cell given in (x,y)
@@ -57,14 +231,16 @@ void neighbors(Cell *matrix, int matrix_w, int matrix_h, int cell_x, int cell_y,
         └───┴───┴───┘  
     */
 
-    out_buffer[0] = &matrix[((cell_y - 1 + matrix_h) % matrix_h) * matrix_w + (cell_x - 1 + matrix_w) % matrix_w];
-    out_buffer[1] = &matrix[((cell_y - 1 + matrix_h) % matrix_h) * matrix_w + (cell_x - 0 + matrix_w) % matrix_w];
-    out_buffer[2] = &matrix[((cell_y - 1 + matrix_h) % matrix_h) * matrix_w + (cell_x + 1 + matrix_w) % matrix_w];
-    out_buffer[3] = &matrix[((cell_y - 0 + matrix_h) % matrix_h) * matrix_w + (cell_x - 1 + matrix_w) % matrix_w];
-    out_buffer[4] = &matrix[((cell_y + 0 + matrix_h) % matrix_h) * matrix_w + (cell_x + 1 + matrix_w) % matrix_w];
-    out_buffer[5] = &matrix[((cell_y + 1 + matrix_h) % matrix_h) * matrix_w + (cell_x - 1 + matrix_w) % matrix_w];
-    out_buffer[6] = &matrix[((cell_y + 1 + matrix_h) % matrix_h) * matrix_w + (cell_x + 0 + matrix_w) % matrix_w];
-    out_buffer[7] = &matrix[((cell_y + 1 + matrix_h) % matrix_h) * matrix_w + (cell_x + 1 + matrix_w) % matrix_w];
+    int left = (cell_x - 1 + cols) % cols;
+    int right = (cell_x + 1) % cols;
+    out_buffer[0] = &above[left];
+    out_buffer[1] = &above[cell_x];
+    out_buffer[2] = &above[right];
+    out_buffer[3] = &row[left];
+    out_buffer[4] = &row[right];
+    out_buffer[5] = &below[left];
+    out_buffer[6] = &below[cell_x];
+    out_buffer[7] = &below[right];
 }
 
 bool is_sick(Cell target)
@@ -80,18 +256,14 @@ int susceptibility(Cell target)
     switch (target.age)
     {
     case CHILD:
-        by_age = 30;
-        break;
     case ADULT:
-        by_age = 50;
-        break;
     case ELDER:
-        by_age = 90;
+        by_age = rule_params.susceptibility[target.age];
         break;
     default:
         break;
     }
-    int by_risk = (target.risk_disease || target.risk_job) ? 15 : 0;
+    int by_risk = (target.risk_disease || target.risk_job) ? rule_params.risk_susceptibility : 0;
 
     return by_age + by_risk;
 }
@@ -108,16 +280,15 @@ int infected_neighbors(Cell **neighbors)
     return infected_count;
 }
 
-void susceptible_to_sick_rule(Cell *target, Cell **neighbors, int time)
+void susceptible_to_sick_rule(Cell *target, int inf_n, int time, CellRng *rng)
 {
-    assert(neighbors != NULL);
-    int inf_n = infected_neighbors(neighbors);
+    assert(target != NULL);
     if (inf_n == 0)
         return; // Can't get sick if there are no infected neighbors
     int susc = susceptibility(*target);
-    double get_sick_chance = ((inf_n / 8) * DISSEASE_STRENGTH) + (susc / 100);
+    double get_sick_chance = ((inf_n / 8) * rule_params.disease_strength) + (susc / 100);
 
-    if (((rand() % 100) / 100) < get_sick_chance)
+    if (((cell_rand(rng) % 100) / 100) < get_sick_chance)
     {
         target->status = SICK_NC_ORANGE;
         target->contagion_t = time;
@@ -128,50 +299,71 @@ void sick_to_contagious_rule(Cell *target, int time)
 {
     assert(target != NULL);
     int elapsed = time - target->contagion_t;
-    if (elapsed == 4)
+    if (elapsed == rule_params.contagious_after)
         target->status = SICK_C_RED;
 }
 
-void contagious_to_isolated_rule(Cell *target, int time)
+void contagious_to_isolated_rule(Cell *target, int time, CellRng *rng)
 {
     assert(target != NULL);
     int elapsed = time - target->contagion_t;
-    if (elapsed == 2)
+    if (elapsed == rule_params.isolation_after)
     {
-        int isolation_chance = 90;
-        if ((rand() % 100) < isolation_chance)
+        if ((cell_rand(rng) % 100) < rule_params.isolation_chance)
             target->status = ISOLATED_YELLOW;
     }
 }
 
-void live_or_die_rule(Cell *target)
+void live_or_die_rule(Cell *target, CellRng *rng)
 {
     assert(target != NULL);
     double by_age = 0;
     switch (target->age)
     {
     case CHILD:
-        by_age = 1;
-        break;
     case ADULT:
-        by_age = 1.3;
-        break;
     case ELDER:
-        by_age = 14.8;
+        by_age = rule_params.death_chance[target->age];
         break;
     default:
         break;
     }
-    double vaccines = target->vaccinated ? 0.5 : 0;
+    double vaccines = target->vaccinated ? rule_params.vaccine_protection : 0;
 
     double death_chance = by_age - vaccines;
 
-    if ((rand() % 100) < death_chance)
+    if ((cell_rand(rng) % 100) < death_chance)
         target->status = DEAD_BLACK;
     else
         target->status = CURED_GREEN;
 }
 
+/*
+    Applies one step of the rules to `target`, a copy of the previous state
+    of the cell. `inf_n` is its number of contagious neighbors, only read
+    when the cell is susceptible.
+*/
+void apply_rules(Cell *target, int inf_n, int time, CellRng *rng)
+{
+    assert(target != NULL);
+    if (target->status == SUSC_BLUE)
+    {
+        susceptible_to_sick_rule(target, inf_n, time, rng);
+    }
+    if (target->status == SICK_NC_ORANGE)
+    {
+        sick_to_contagious_rule(target, time);
+    }
+    if (target->status == SICK_C_RED)
+    {
+        contagious_to_isolated_rule(target, time, rng);
+    }
+    if (is_sick(*target) && (time - target->contagion_t) == rule_params.resolution_after)
+    {
+        live_or_die_rule(target, rng);
+    }
+}
+
 void new_random_alive_cell(Cell *c)
 {
     assert(c != NULL);
@@ -196,6 +388,21 @@ void new_random_alive_cell(Cell *c)
     c->contagion_t = 0;
 }
 
+// Cells of a `w` x `h` grid, beyond an int for grids like 50k x 50k
+size_t grid_cells(int w, int h)
+{
+    return (size_t)w * (size_t)h;
+}
+
+// malloc() of `n_cells` cells, with an error instead of NULL going unnoticed on large grids
+Cell *grid_alloc(size_t n_cells)
+{
+    Cell *cells = malloc(n_cells * sizeof(Cell));
+    if (cells == NULL && n_cells > 0)
+        fprintf(stderr, "[ERR] Can't allocate %zu cells (%zu MiB)\n", n_cells, (n_cells * sizeof(Cell)) >> 20);
+    return cells;
+}
+
 void init_cell_matrix(Cell *matrix, int w, int h)
 {
     assert(matrix != NULL);
@@ -203,7 +410,7 @@ void init_cell_matrix(Cell *matrix, int w, int h)
     {
         for (int j = 0; j < w; j++)
         {
-            int pos = i * w + j;
+            size_t pos = (size_t)i * (size_t)w + (size_t)j;
             if (rand() % 100 < 50)
                 matrix[pos].status = EMPTY_WHITE;
             else
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "utils.h"
+
+/*
+    Client of the simulation daemon (see src/daemon.c): sends the job made
+    of its arguments and prints the trace the daemon streams back. Paths
+    are read by the daemon, relative ones from its working directory, and
+    can't hold blanks. Exits with 0 when the job is done.
+*/
+
+#define SUBMIT_USAGE "Usage: %s <socket> <rows> <cols> <t|f> [options] | %s <socket> shutdown\n"
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, SUBMIT_USAGE, argv[0], argv[0]);
+        return -1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "[ERR] Socket path too long: '%s'\n", argv[1]);
+        return -1;
+    }
+    strcpy(addr.sun_path, argv[1]);
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || connect(server, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "[ERR] No daemon listening on '%s'\n", argv[1]);
+        return -1;
+    }
+
+    FILE *out = fdopen(dup(server), "w");
+    FILE *in = fdopen(server, "r");
+    for (int k = 2; k < argc; k++)
+        fprintf(out, k + 1 < argc ? "%s " : "%s\n", argv[k]);
+    fclose(out);
+
+    char line[1024];
+    bool done = false;
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        done = strcmp(line, "# done\n") == 0;
+        fputs(line, stdout);
+    }
+    fclose(in);
+    return done ? 0 : -1;
+}
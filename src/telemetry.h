@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+    Live telemetry (--telemetry=NAME[:EVERY]). Every step the backend
+    publishes a fixed-layout TelemetryRecord, its step, latency, update
+    time and the status counts of its cells, into a ring of records in
+    a file mapped from /dev/shm, read by build/covidsim-top (see
+    src/covidsim-top.c) while the run goes on. Each MPI rank writes its
+    own ring, NAME.<rank>.
+
+    There is one writer per ring and no lock: a slot's `seq` is odd while
+    the writer fills it and 2 * (n + 1) once record n is complete, and
+    `head` counts the records published. A reader copies a slot and keeps
+    the copy only if `seq` held the same expected value before and after.
+    Publishing is a clock read and a few stores, the status counts are
+    only refreshed every EVERY steps (default TELEMETRY_EVERY) since they
+    take a pass over the cells. The file stays after the run, for a last
+    look, and is reused by the next run of the same name.
+*/
+
+#define TELEMETRY_MAGIC "COVIDTEL"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_SLOTS 4096 // Power of 2
+#define TELEMETRY_EVERY 16
+#define TELEMETRY_DIR "/dev/shm/covidsim-"
+
+typedef struct TelemetryRecord
+{
+    uint64_t seq;
+    int64_t step;
+    int64_t time_ns;              // CLOCK_MONOTONIC at the end of the step
+    int64_t step_ns;              // Since the end of the previous step
+    int64_t update_ns;            // Of it, computing cells. The rest waits on communication, I/O and rendering.
+    int64_t counts_step;          // Step the counts were taken at, -1 before any
+    int64_t counts[STATUS_KINDS]; // By status, in the order of the traces (see trace.h)
+    char pad[128 - (6 + STATUS_KINDS) * sizeof(int64_t)]; // Two whole cache lines
+} TelemetryRecord;
+
+typedef struct TelemetryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+    int32_t rank;
+    int32_t nprocs;
+    int32_t rows; // Of the whole grid
+    int32_t cols;
+    int64_t cells; // Of this writer
+    int64_t pid;
+    uint64_t head; // Records published
+    char pad[128 - 7 * sizeof(int64_t)];
+} TelemetryHeader;
+
+typedef struct Telemetry
+{
+    TelemetryHeader *header; // NULL when telemetry is off
+    TelemetryRecord *ring;
+    int every;
+    int64_t last_ns; // End of the previous step
+    int64_t counts_step;
+    int64_t counts[STATUS_KINDS];
+} Telemetry;
+
+int64_t telemetry_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// telemetry_now() when telemetry is on, 0 otherwise so runs without it don't read the clock
+int64_t telemetry_clock(const Telemetry *tel)
+{
+    return tel->header != NULL ? telemetry_now() : 0;
+}
+
+// Path of the ring of `rank` for `name`, a path or a name under /dev/shm
+void telemetry_path(const char *name, int rank, int nprocs, char *path, size_t size)
+{
+    const char *dir = strchr(name, '/') != NULL ? "" : TELEMETRY_DIR;
+    if (nprocs > 1)
+        snprintf(path, size, "%s%s.%d", dir, name, rank);
+    else
+        snprintf(path, size, "%s%s", dir, name);
+}
+
+/*
+    Creates the ring of `rank` out of `nprocs` writers for `spec`
+    (NAME[:EVERY]), NULL turns telemetry off. `cells` are the cells this
+    writer counts. Returns -1 on error.
+*/
+int telemetry_open(Telemetry *tel, const char *spec, int rank, int nprocs, int rows, int cols, int64_t cells)
+{
+    tel->header = NULL;
+    if (spec == NULL)
+        return 0;
+    char name[4096];
+    snprintf(name, sizeof(name), "%s", spec);
+    char *every = strrchr(name, ':');
+    tel->every = TELEMETRY_EVERY;
+    if (every != NULL)
+    {
+        *every = '\0';
+        tel->every = MAX(atoi(every + 1), 1);
+    }
+    char path[4096 + 64];
+    telemetry_path(name, rank, nprocs, path, sizeof(path));
+    size_t bytes = sizeof(TelemetryHeader) + TELEMETRY_SLOTS * sizeof(TelemetryRecord);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)bytes) != 0)
+    {
+        fprintf(stderr, "[ERR] Can't create the telemetry ring '%s'\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERR] Can't map the telemetry ring '%s'\n", path);
+        return -1;
+    }
+    tel->header = map;
+    tel->ring = (TelemetryRecord *)((char *)map + sizeof(TelemetryHeader));
+    TelemetryHeader *h = tel->header;
+    h->version = TELEMETRY_VERSION;
+    h->slots = TELEMETRY_SLOTS;
+    h->rank = rank;
+    h->nprocs = nprocs;
+    h->rows = rows;
+    h->cols = cols;
+    h->cells = cells;
+    h->pid = (int64_t)getpid();
+    h->head = 0;
+    // Readers check the magic last
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(h->magic, TELEMETRY_MAGIC, 8);
+    tel->last_ns = telemetry_now();
+    tel->counts_step = -1;
+    memset(tel->counts, 0, sizeof(tel->counts));
+    return 0;
+}
+
+// Whether the counts of step `step` are due, see telemetry_count()
+bool telemetry_due(const Telemetry *tel, int step)
+{
+    return tel->header != NULL && step % tel->every == 0;
+}
+
+// Counts the statuses of `cells`, all the writer's, for the records from step `step` on
+void telemetry_count(Telemetry *tel, const Cell *cells, size_t n, int step)
+{
+    int64_t counts[STATUS_KINDS] = {0};
+    for (size_t k = 0; k < n; k++)
+        counts[status_index(cells[k].status)]++;
+    memcpy(tel->counts, counts, sizeof(counts));
+    tel->counts_step = step;
+    // MPI ranks own fewer or more cells after a repartition
+    tel->header->cells = (int64_t)n;
+}
+
+// Publishes the record of step `step`, which spent `update_ns` computing cells
+void telemetry_publish(Telemetry *tel, int step, int64_t update_ns)
+{
+    if (tel->header == NULL)
+        return;
+    int64_t now = telemetry_now();
+    uint64_t n = tel->header->head;
+    TelemetryRecord *r = &tel->ring[n & (TELEMETRY_SLOTS - 1)];
+    __atomic_store_n(&r->seq, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->step = step;
+    r->time_ns = now;
+    r->step_ns = now - tel->last_ns;
+    r->update_ns = update_ns;
+    r->counts_step = tel->counts_step;
+    memcpy(r->counts, tel->counts, sizeof(tel->counts));
+    __atomic_store_n(&r->seq, 2 * n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&tel->header->head, n + 1, __ATOMIC_RELEASE);
+    tel->last_ns = now;
+}
+
+void telemetry_close(Telemetry *tel)
+{
+    if (tel->header != NULL)
+        munmap(tel->header, sizeof(TelemetryHeader) + TELEMETRY_SLOTS * sizeof(TelemetryRecord));
+}
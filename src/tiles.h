@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+    Hybrid engine (--tiles=N): the grid is split in N x N tiles and only the
+    tiles where something can happen are simulated cell by cell.
+
+    A tile summarizes its cells by the number of contagious ones and the
+    first step at which one of its sick cells reaches a state change
+    (contagious, isolation or resolution). Without contagious cells in the
+    tile or in the tiles around it no susceptible cell can get sick, and
+    before that step no sick cell changes, so the tile is left as it is: the
+    compartments advance without any per-cell work. The tile switches back
+    to per-cell simulation as soon as the infection front reaches its
+    neighborhood or one of its sick cells is due. The rules draw per cell
+    from (seed, time, cell), so both paths give exactly the same grid.
+*/
+
+typedef struct Tile
+{
+    int contagious; // SICK_C_RED cells, from the last update of the tile
+    int next_event; // First step at which one of its sick cells changes, INT32_MAX if none
+    bool synced;    // Both grids hold the same cells for this tile
+} Tile;
+
+typedef struct TileMap
+{
+    int size;
+    int tile_rows;
+    int tile_cols;
+    Tile *tiles;
+    bool *active; // Tiles simulated cell by cell in the current step
+    Cell *scratch; // 4 rows of size + 2 cells per thread
+    long updated; // Tile steps simulated cell by cell
+    long skipped; // Tile steps left to the summaries
+} TileMap;
+
+// Position of tile (ti, tj) in `tiles` and `active`
+static size_t tile_index(const TileMap *map, int ti, int tj)
+{
+    return (size_t)ti * (size_t)map->tile_cols + (size_t)tj;
+}
+
+// Step at which a cell infected at `contagion_t` next changes after `time`
+static int tile_cell_event(Cell c, int time)
+{
+    int next = INT32_MAX;
+    int elapsed[3] = {rule_params.contagious_after, rule_params.isolation_after, rule_params.resolution_after};
+    bool applies[3] = {c.status == SICK_NC_ORANGE, c.status == SICK_C_RED, true};
+    for (int k = 0; k < 3; k++)
+    {
+        int at = c.contagion_t + elapsed[k];
+        if (applies[k] && at > time)
+            next = MIN(next, at);
+    }
+    return next;
+}
+
+// Recomputes the summary of tile (ti, tj) from the cells of `matrix` at `time`
+void tile_summarize(TileMap *map, Cell *matrix, int w, int h, int ti, int tj, int time)
+{
+    Tile *tile = &map->tiles[tile_index(map, ti, tj)];
+    tile->contagious = 0;
+    tile->next_event = INT32_MAX;
+    int row_end = MIN(h, (ti + 1) * map->size);
+    int col_end = MIN(w, (tj + 1) * map->size);
+    for (int i = ti * map->size; i < row_end; i++)
+    {
+        for (int j = tj * map->size; j < col_end; j++)
+        {
+            Cell c = matrix[(size_t)i * (size_t)w + (size_t)j];
+            if (!is_sick(c))
+                continue;
+            tile->contagious += c.status == SICK_C_RED;
+            tile->next_event = MIN(tile->next_event, tile_cell_event(c, time));
+        }
+    }
+}
+
+void tiles_init(TileMap *map, int size, int threads, Cell *matrix, int w, int h)
+{
+    assert(map != NULL && size > 0);
+    map->size = size;
+    map->tile_rows = (h + size - 1) / size;
+    map->tile_cols = (w + size - 1) / size;
+    map->tiles = malloc((size_t)map->tile_rows * (size_t)map->tile_cols * sizeof(Tile));
+    map->active = malloc((size_t)map->tile_rows * (size_t)map->tile_cols * sizeof(bool));
+    map->scratch = malloc((size_t)threads * 4 * (size_t)(size + 2) * sizeof(Cell));
+    map->updated = 0;
+    map->skipped = 0;
+    for (int ti = 0; ti < map->tile_rows; ti++)
+    {
+        for (int tj = 0; tj < map->tile_cols; tj++)
+        {
+            // The initial state is at step 0, nothing changed before it
+            tile_summarize(map, matrix, w, h, ti, tj, -1);
+            map->tiles[tile_index(map, ti, tj)].synced = false;
+        }
+    }
+}
+
+void tiles_free(TileMap *map)
+{
+    free(map->tiles);
+    free(map->active);
+    free(map->scratch);
+}
+
+/*
+    Marks the tiles to simulate at `time`. Must run before any tile of the
+    step is updated, the neighbors are read as they were before the step.
+*/
+void tiles_plan(TileMap *map, int time)
+{
+    for (int ti = 0; ti < map->tile_rows; ti++)
+    {
+        for (int tj = 0; tj < map->tile_cols; tj++)
+        {
+            bool active = map->tiles[tile_index(map, ti, tj)].next_event <= time;
+            for (int di = -1; di <= 1 && !active; di++)
+            {
+                for (int dj = -1; dj <= 1 && !active; dj++)
+                {
+                    int ni = (ti + di + map->tile_rows) % map->tile_rows;
+                    int nj = (tj + dj + map->tile_cols) % map->tile_cols;
+                    active = map->tiles[tile_index(map, ni, nj)].contagious > 0;
+                }
+            }
+            map->active[tile_index(map, ti, tj)] = active;
+            if (active)
+                map->updated++;
+            else
+                map->skipped++;
+        }
+    }
+}
+
+// Copies columns [c0 - 1, c0 + len] of row `i`, wrapping around, to `dst`
+static void tile_window_row(Cell *dst, Cell *matrix, int w, int i, int c0, int len)
+{
+    const Cell *row = &matrix[(size_t)i * (size_t)w];
+    dst[0] = row[(c0 - 1 + w) % w];
+    memcpy(&dst[1], &row[c0], (size_t)len * sizeof(Cell));
+    dst[len + 1] = row[(c0 + len) % w];
+}
+
+/*
+    Advances tile (ti, tj) from `matrix` into `upd_matrix`. Active tiles run
+    the kernel on windows of the tile rows padded with one column on each
+    side (the kernel wraps columns within its row, the padding cells are
+    discarded). `thread` selects the scratch rows.
+*/
+void tile_update(TileMap *map, RowKernel kernel, Cell *matrix, Cell *upd_matrix, int w, int h,
+                 int ti, int tj, int time, uint64_t seed, int thread)
+{
+    Tile *tile = &map->tiles[tile_index(map, ti, tj)];
+    int c0 = tj * map->size;
+    int len = MIN(map->size, w - c0);
+    int row_end = MIN(h, (ti + 1) * map->size);
+
+    if (!map->active[tile_index(map, ti, tj)])
+    {
+        if (!tile->synced)
+        {
+            for (int i = ti * map->size; i < row_end; i++)
+            {
+                size_t at = (size_t)i * (size_t)w + (size_t)c0;
+                memcpy(&upd_matrix[at], &matrix[at], (size_t)len * sizeof(Cell));
+            }
+            tile->synced = true;
+        }
+        return;
+    }
+
+    Cell *above = &map->scratch[(size_t)thread * 4 * (size_t)(map->size + 2)];
+    Cell *row = &above[map->size + 2];
+    Cell *below = &row[map->size + 2];
+    Cell *out = &below[map->size + 2];
+    for (int i = ti * map->size; i < row_end; i++)
+    {
+        tile_window_row(above, matrix, w, (i - 1 + h) % h, c0, len);
+        tile_window_row(row, matrix, w, i, c0, len);
+        tile_window_row(below, matrix, w, (i + 1) % h, c0, len);
+        // Cell k of the window is global column c0 + k - 1
+        kernel(above, row, below, out, len + 2, time, seed, (uint64_t)i * (uint64_t)w + (uint64_t)c0 - 1);
+        memcpy(&upd_matrix[(size_t)i * (size_t)w + (size_t)c0], &out[1], (size_t)len * sizeof(Cell));
+    }
+    tile->synced = false;
+    tile_summarize(map, upd_matrix, w, h, ti, tj, time);
+}
+
+// Draws the long-range contacts (see mobility.h) of tile (ti, tj) of `matrix` at `time`
+void tile_contacts(TileMap *map, Mobility *mob, int thread, Cell *matrix, int w, int h,
+                   int ti, int tj, int time, uint64_t seed)
+{
+    // Skipped tiles have no contagious cells
+    if (map->tiles[tile_index(map, ti, tj)].contagious == 0)
+        return;
+    int r0 = ti * map->size;
+    int c0 = tj * map->size;
+    mobility_contacts(mob, thread, &matrix[(size_t)r0 * (size_t)w], w, h, r0, MIN(map->size, h - r0), c0,
+                      MIN(map->size, w - c0), time, seed);
+}
+
+/*
+    Long-range contacts (see mobility.h) infect cells of any tile after the
+    tiles were updated: the tiles of the `n` exposed cells of `matrix`
+    infected at `time` get their next event and go back to being copied.
+*/
+void tiles_mark_exposed(TileMap *map, Cell *matrix, int w, const uint64_t *cells, size_t n, int time)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        Cell c = matrix[cells[k]];
+        if (c.status != SICK_NC_ORANGE || c.contagion_t != time)
+            continue;
+        int i = (int)(cells[k] / (uint64_t)w);
+        int j = (int)(cells[k] % (uint64_t)w);
+        Tile *tile = &map->tiles[tile_index(map, i / map->size, j / map->size)];
+        tile->synced = false;
+        tile->next_event = MIN(tile->next_event, tile_cell_event(c, time));
+    }
+}
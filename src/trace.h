@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+    Golden traces: one line per step with a hash of the whole grid and the
+    number of cells in each status. Step 0 is the initial grid, step n the
+    grid after n updates. See test/golden.sh.
+*/
+
+#define STATUS_KINDS 7
+
+const CellStatus status_kinds[STATUS_KINDS] = {
+    EMPTY_WHITE,
+    SUSC_BLUE,
+    SICK_NC_ORANGE,
+    SICK_C_RED,
+    ISOLATED_YELLOW,
+    CURED_GREEN,
+    DEAD_BLACK};
+
+int status_index(CellStatus status)
+{
+    switch (status)
+    {
+    case EMPTY_WHITE:
+        return 0;
+    case SUSC_BLUE:
+        return 1;
+    case SICK_NC_ORANGE:
+        return 2;
+    case SICK_C_RED:
+        return 3;
+    case ISOLATED_YELLOW:
+        return 4;
+    case CURED_GREEN:
+        return 5;
+    case DEAD_BLACK:
+        return 6;
+    default:
+        return -1;
+    }
+}
+
+// Empty cells never get their other fields initialized, only the status counts
+int32_t cell_trace_time(Cell c)
+{
+    return c.status == EMPTY_WHITE ? 0 : (int32_t)c.contagion_t;
+}
+
+uint64_t fnv1a_update(uint64_t hash, uint32_t value)
+{
+    for (int b = 0; b < 4; b++)
+    {
+        hash ^= (value >> (b * 8)) & 0xFF;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/*
+    Hash and status counts of a grid, accumulated in row-major order so
+    engines that stream the grid can build them piece by piece.
+*/
+typedef struct TraceSum
+{
+    uint64_t hash;
+    long counts[STATUS_KINDS];
+} TraceSum;
+
+void trace_begin(TraceSum *sum)
+{
+    sum->hash = 0xCBF29CE484222325ULL;
+    for (int k = 0; k < STATUS_KINDS; k++)
+        sum->counts[k] = 0;
+}
+
+void trace_add(TraceSum *sum, const Cell *cells, size_t n)
+{
+    assert(cells != NULL);
+    for (size_t i = 0; i < n; i++)
+    {
+        Cell c = cells[i];
+        sum->hash = fnv1a_update(sum->hash, (uint32_t)c.status);
+        sum->hash = fnv1a_update(sum->hash, (uint32_t)cell_trace_time(c));
+        int k = status_index(c.status);
+        assert(k >= 0);
+        sum->counts[k] += 1;
+    }
+}
+
+void trace_end(FILE *trace, int step, const TraceSum *sum)
+{
+    assert(trace != NULL);
+    fprintf(trace, "%d %016llx", step, (unsigned long long)sum->hash);
+    for (int k = 0; k < STATUS_KINDS; k++)
+        fprintf(trace, " %ld", sum->counts[k]);
+    fprintf(trace, "\n");
+}
+
+void trace_step(FILE *trace, int step, const Cell *matrix, int w, int h)
+{
+    assert(matrix != NULL);
+    TraceSum sum;
+    trace_begin(&sum);
+    trace_add(&sum, matrix, (size_t)w * (size_t)h);
+    trace_end(trace, step, &sum);
+}
+
+FILE *trace_open(const char *path)
+{
+    if (path == NULL)
+        return NULL;
+    FILE *trace = fopen(path, "w");
+    if (trace == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't open trace file '%s'\n", path);
+        return NULL;
+    }
+    fprintf(trace, "# step hash empty susc sick_nc sick_c isolated cured dead\n");
+    return trace;
+}
+
+/*
+    Raw dump of the grid, 8 bytes per cell in row-major order, so the first
+    differing cell of two dumps is `cmp` offset / 8.
+*/
+int dump_grid(const char *path, const Cell *matrix, int w, int h)
+{
+    FILE *dump = fopen(path, "wb");
+    if (dump == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't open dump file '%s'\n", path);
+        return -1;
+    }
+    for (int i = 0; i < h; i++)
+    {
+        for (int j = 0; j < w; j++)
+        {
+            Cell c = matrix[(size_t)i * (size_t)w + (size_t)j];
+            int32_t record[2] = {(int32_t)c.status, cell_trace_time(c)};
+            fwrite(record, sizeof(record), 1, dump);
+        }
+    }
+    fclose(dump);
+    return 0;
+}
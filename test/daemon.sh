@@ -0,0 +1,176 @@
+#!/bin/bash
+# Checks the simulation daemon (src/daemon.c) against the golden traces.
+#
+# Starts build/daemon on a temporary socket, submits every size with each
+# kernel through build/submit, twice so the second job runs on pooled
+# buffers, then concurrent jobs and a few bad ones, and compares the
+# streamed traces with test/golden. A second daemon with --cache then
+# runs each size short, extended, repeated and dumped, and must answer
+# exactly what the uncached runs do.
+#
+# Usage: bash test/daemon.sh
+
+BUILD=${BUILD:-build}
+GOLDEN=${GOLDEN:-test/golden}
+SEED=${SEED:-31415926}
+STEPS=${STEPS:-120}
+SIZES=${SIZES:-"12x12 60x60 120x84"}
+KERNELS=${KERNELS:-"scalar sse4.2 avx2 avx512 auto"}
+THREADS=${THREADS:-2}
+
+TMP=$(mktemp -d)
+SOCKET=$TMP/daemon.sock
+$BUILD/daemon $SOCKET --threads=$THREADS > $TMP/daemon.log 2>&1 &
+DAEMON=$!
+trap 'kill $DAEMON 2> /dev/null; rm -rf "$TMP"' EXIT
+for k in $(seq 50); do
+    [ -S $SOCKET ] && break
+    sleep 0.1
+done
+
+failures=0
+checks=0
+
+# check <name> <trace> <size>
+check() {
+    local name=$1 trace=$2 size=$3
+    checks=$((checks + 1))
+    if diff <(grep -v '^#' "$GOLDEN/$size.trace") <(grep -v '^#' "$trace") > /dev/null && grep -q '^# done$' "$trace"; then
+        echo "[ OK ] $name"
+    else
+        echo "[FAIL] $name"
+        failures=$((failures + 1))
+    fi
+}
+
+for size in $SIZES; do
+    rows=${size%x*}
+    cols=${size#*x}
+    for kernel in $KERNELS; do
+        # Kernels this CPU lacks fail on the daemon's side too
+        if ! $BUILD/main $rows $cols f --steps=0 --kernel=$kernel > /dev/null 2>&1; then
+            echo "[SKIP] --kernel=$kernel is not supported here"
+            continue
+        fi
+        for run in 1 2; do
+            $BUILD/submit $SOCKET $rows $cols f --seed=$SEED --steps=$STEPS --kernel=$kernel > $TMP/got.trace
+            check "$size --kernel=$kernel (job $run)" $TMP/got.trace $size
+        done
+    done
+done
+
+# Jobs queue up when several clients connect at once
+for size in $SIZES; do
+    rows=${size%x*}
+    cols=${size#*x}
+    $BUILD/submit $SOCKET $rows $cols f --seed=$SEED --steps=$STEPS > $TMP/$size.trace &
+done
+wait $(jobs -p | grep -v "^$DAEMON$")
+for size in $SIZES; do
+    check "$size concurrent" $TMP/$size.trace $size
+done
+
+# Bad jobs report their error and leave the daemon running
+for job in "12 12 f --kernel=none" "12 12 f --tiles=3" "12 12 f --sync=neighbors" "12 12 f --telemetry=job" "1 1 f" "12 12 f --rules=rules/mobility.rules"; do
+    checks=$((checks + 1))
+    if ! $BUILD/submit $SOCKET $job > $TMP/bad.trace 2>&1 && grep -q '^\[ERR\]' $TMP/bad.trace; then
+        echo "[ OK ] rejects '$job'"
+    else
+        echo "[FAIL] accepted '$job'"
+        failures=$((failures + 1))
+    fi
+done
+
+checks=$((checks + 1))
+if $BUILD/submit $SOCKET shutdown > /dev/null && wait $DAEMON; then
+    echo "[ OK ] shutdown"
+else
+    echo "[FAIL] shutdown"
+    failures=$((failures + 1))
+fi
+
+# Cached runs: misses, extensions of a shorter run and hits give the same traces and dumps
+CACHE=$TMP/cache
+SOCKET=$TMP/cached.sock
+$BUILD/daemon $SOCKET --threads=$THREADS --cache=$CACHE > $TMP/daemon.log 2>&1 &
+DAEMON=$!
+for k in $(seq 50); do
+    [ -S $SOCKET ] && break
+    sleep 0.1
+done
+
+# check_prefix <name> <trace> <size> <steps>
+check_prefix() {
+    local name=$1 trace=$2 size=$3 steps=$4
+    checks=$((checks + 1))
+    if diff <(grep -v '^#' "$GOLDEN/$size.trace" | head -n $((steps + 1))) <(grep -v '^#' "$trace") > /dev/null &&
+        grep -q '^# done$' "$trace"; then
+        echo "[ OK ] $name"
+    else
+        echo "[FAIL] $name"
+        failures=$((failures + 1))
+    fi
+}
+
+# check_same <name> <a> <b>
+check_same() {
+    checks=$((checks + 1))
+    if cmp -s "$2" "$3"; then
+        echo "[ OK ] $1"
+    else
+        echo "[FAIL] $1"
+        failures=$((failures + 1))
+    fi
+}
+
+HALF=$((STEPS / 2))
+for size in $SIZES; do
+    rows=${size%x*}
+    cols=${size#*x}
+    job="$rows $cols f --seed=$SEED"
+    $BUILD/submit $SOCKET $job --steps=$HALF > $TMP/got.trace
+    check_prefix "$size cache miss" $TMP/got.trace $size $HALF
+    $BUILD/submit $SOCKET $job --steps=$STEPS > $TMP/got.trace
+    check "$size cache resume" $TMP/got.trace $size
+    inode=$(stat -c %i $CACHE/*.run | sort)
+    $BUILD/submit $SOCKET $job --steps=$STEPS --kernel=scalar > $TMP/got.trace
+    check "$size cache hit" $TMP/got.trace $size
+    $BUILD/submit $SOCKET $job --steps=$HALF > $TMP/got.trace
+    check_prefix "$size cache hit, shorter" $TMP/got.trace $size $HALF
+    check_same "$size cache hits leave the cache alone" <(echo "$inode") <(stat -c %i $CACHE/*.run | sort)
+    for steps in $HALF $STEPS; do
+        $BUILD/main $job --steps=$steps --dump=$TMP/ref.dump > /dev/null 2>&1
+        $BUILD/submit $SOCKET $job --steps=$steps --dump=$TMP/got.dump > /dev/null
+        check_same "$size cache dump at $steps steps" $TMP/ref.dump $TMP/got.dump
+    done
+done
+
+# The population raster is part of the key
+rows=60
+cols=60
+for pop in 1 2; do
+    $BUILD/mkpop $rows $cols $TMP/pop.raster --seed=$pop > /dev/null 2>&1
+    $BUILD/main $rows $cols f --seed=$SEED --steps=$STEPS --population=$TMP/pop.raster --trace=$TMP/ref.trace > /dev/null 2>&1
+    $BUILD/submit $SOCKET $rows $cols f --seed=$SEED --steps=$STEPS --population=$TMP/pop.raster > $TMP/got.trace
+    check_same "cache keyed by population $pop" <(grep -v '^#' $TMP/ref.trace) <(grep -v '^#' $TMP/got.trace)
+done
+
+# A run whose trace is a line short, with the size its header claims, is a miss
+size=${SIZES%% *}
+rm -f $CACHE/*.run
+$BUILD/submit $SOCKET ${size%x*} ${size#*x} f --seed=$SEED --steps=$HALF > /dev/null
+run=$(ls $CACHE/*.run)
+printf ' ' | dd of=$run bs=1 seek=$(($(stat -c %s $run) - 1)) conv=notrunc 2> /dev/null
+$BUILD/submit $SOCKET ${size%x*} ${size#*x} f --seed=$SEED --steps=$HALF > $TMP/got.trace
+check_prefix "$size cut trace is a cache miss" $TMP/got.trace $size $HALF
+
+checks=$((checks + 1))
+if $BUILD/submit $SOCKET shutdown > /dev/null && wait $DAEMON; then
+    echo "[ OK ] cached shutdown"
+else
+    echo "[FAIL] cached shutdown"
+    failures=$((failures + 1))
+fi
+
+echo "[INFO] $((checks - failures))/$checks daemon checks passed"
+[ $failures -eq 0 ]
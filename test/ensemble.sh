@@ -0,0 +1,111 @@
+#!/bin/bash
+# Checks the adaptive ensemble driver (src/ensemble.c).
+#
+# With a fixed number of replicas the estimates must match the ones
+# computed from build/main traces of the same seeds, whatever the ranks
+# and threads. With a target precision every scenario must stop either
+# converged, within that precision, or at --max replicas.
+#
+# Usage: bash test/ensemble.sh
+
+BUILD=${BUILD:-build}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+REPLICAS=${REPLICAS:-6}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+cat > $TMP/scenarios <<EOF
+# Two sizes and the default rules spelled out
+60 60 f --seed=100 --steps=120
+30 30 f --seed=200 --steps=80 --rules=rules/default.rules
+EOF
+
+failures=0
+checks=0
+
+# check <name> <command...>: passes when the command succeeds
+check() {
+    local name=$1
+    shift
+    checks=$((checks + 1))
+    if "$@"; then
+        echo "[ OK ] $name"
+    else
+        echo "[FAIL] $name"
+        failures=$((failures + 1))
+    fi
+}
+
+# expected <scenarios>: report lines from build/main traces, peak sick, its step and final dead
+expected() {
+    s=0
+    grep -v '^#' $1 | while read -r rows cols gui args; do
+        seed=$(echo "$args" | sed 's/.*--seed=\([0-9]*\).*/\1/')
+        for k in $(seq 0 $((REPLICAS - 1))); do
+            $BUILD/main $rows $cols $gui ${args/--seed=$seed/--seed=$((seed + k))} --trace=$TMP/$k.trace \
+                > /dev/null 2>&1
+            grep -v '^#' $TMP/$k.trace |
+                awk '{ sick = $5 + $6 + $7; if (NR == 1 || sick > peak) { peak = sick; at = $1 } dead = $9 }
+                     END { print peak, at, dead }'
+        done | awk -v s=$s -v n=$REPLICAS '{ for (m = 1; m <= 3; m++) { sum[m] += $m; sq[m] += $m * $m } }
+            END {
+                printf "%d %d no", s, n
+                for (m = 1; m <= 3; m++) {
+                    mean = sum[m] / n
+                    var = (sq[m] - sum[m] * mean) / (n - 1)
+                    printf " %.3f %.3f", mean, 1.959964 * sqrt(var > 0 ? var / n : 0)
+                }
+                printf "\n"
+            }'
+        s=$((s + 1))
+    done
+}
+
+# Only the means, the interval widths depend on the last digits of z
+means() {
+    grep -v '^\[DBG\]' "$1" | grep -v '^#' | awk '{ print $1, $2, $4, $6, $8 }'
+}
+
+fixed="--min=$REPLICAS --max=$REPLICAS --precision=0"
+OMP_NUM_THREADS=1 $BUILD/ensemble $TMP/scenarios $fixed > $TMP/serial.out 2>&1
+check "fixed replicas match build/main" diff <(means <(expected $TMP/scenarios)) <(means $TMP/serial.out)
+for layout in "1 3" "2 1" "2 2" "3 2"; do
+    np=${layout% *}
+    threads=${layout#* }
+    $MPIRUN -np $np env OMP_NUM_THREADS=$threads $BUILD/ensemble $TMP/scenarios $fixed > $TMP/par.out 2>&1
+    check "$np ranks x $threads threads match 1 thread" diff <(grep -v '^\[DBG\]' $TMP/serial.out) \
+        <(grep -v '^\[DBG\]' $TMP/par.out)
+done
+
+# Adaptive runs stop converged within the precision, or at --max
+PRECISION=0.3
+MAX=200
+$MPIRUN -np 2 env OMP_NUM_THREADS=2 $BUILD/ensemble $TMP/scenarios --precision=$PRECISION --min=10 --max=$MAX \
+    > $TMP/adaptive.out 2>&1
+check "adaptive ensemble stops each scenario" awk -v p=$PRECISION -v max=$MAX '
+    /^\[DBG\]/ || /^#/ { next }
+    { n++ }
+    $3 == "yes" {
+        if ($2 < 10) exit 1
+        for (m = 4; m <= 8; m += 2)
+            if ($(m + 1) > p * ($m > 1 ? $m : 1)) exit 1
+    }
+    $3 == "no" && $2 != max { exit 1 }
+    END { exit n != 2 }' $TMP/adaptive.out
+
+# More scenarios than the array first holds, whose options point into their lines
+$BUILD/mkpop 20 20 $TMP/20x20.pop --seed=5 > /dev/null
+for k in $(seq 1 20); do
+    echo "20 20 f --seed=$((k * 100)) --steps=30 --population=$TMP/20x20.pop"
+done > $TMP/many
+OMP_NUM_THREADS=2 $BUILD/ensemble $TMP/many $fixed > $TMP/many.out 2>&1
+check "20 scenarios match build/main" diff <(means <(expected $TMP/many)) <(means $TMP/many.out)
+
+# Scenarios the driver can't run are rejected before any replica
+for bad in "12 12 f --tiles=3" "12 12 f --telemetry=replica"; do
+    echo "$bad" > $TMP/bad
+    check "rejects '$bad'" bash -c "! $BUILD/ensemble $TMP/bad > /dev/null 2>&1"
+done
+
+echo "[INFO] $((checks - failures))/$checks ensemble checks passed"
+[ $failures -eq 0 ]
@@ -0,0 +1,204 @@
+#!/bin/bash
+# Differential golden-trace harness.
+#
+# Runs every backend from a fixed seed on several grid sizes and rank/thread
+# counts and compares the per-step grid hash and status counts (see
+# src/trace.h) against the stored traces in test/golden. On mismatch it
+# reports the first differing step and, by dumping both grids at that step,
+# the first differing cell.
+#
+# Usage: bash test/golden.sh [--update]
+#   --update  regenerate test/golden from the sequential backend and the
+#             scalar kernel
+
+BUILD=${BUILD:-build}
+GOLDEN=${GOLDEN:-test/golden}
+SEED=${SEED:-31415926}
+STEPS=${STEPS:-120}
+SIZES=${SIZES:-"12x12 60x60 120x84"}
+PROCS=${PROCS:-"1 2 4 5"}
+THREADS=${THREADS:-"1 2 4"}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+# Flags of every run, the reference included (e.g. another rule spec)
+FLAGS=${FLAGS:-""}
+# Extra engine flags every backend is also checked with, one variant per entry
+# (--balance=1:1.0 repartitions the MPI slabs after every step, population
+# reads the initial grid from a raster written by build/mkpop, graph updates
+# the torus written as a contact graph by build/mkgraph). Backends that
+# don't implement a variant must reject it, see supports().
+VARIANTS=${VARIANTS:-"default --kernel=scalar --kernel=sse4.2 --kernel=avx2 --kernel=avx512 --kernel=specialized --balance=1:1.0 --update=rolling --tiles=5 --layout=morton --layout=hilbert --halo=3 --halo=auto --shm population graph"}
+# OpenMP flags that can't trace every step, checked on the final grid
+# (--sync=neighbors lets threads run a step ahead of the bands not next to them),
+# the other backends must reject them
+DUMP_VARIANTS=${DUMP_VARIANTS-"--sync=neighbors"}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+failures=0
+checks=0
+
+# variant_flags <variant> <rows> <cols>
+variant_flags() {
+    if [ "$1" == "default" ]; then
+        echo ""
+    elif [ "$1" == "population" ]; then
+        echo "--population=$TMP/${2}x${3}.pop"
+    elif [ "$1" == "graph" ]; then
+        echo "--graph=$TMP/${2}x${3}.graph"
+    else
+        echo "$1"
+    fi
+}
+
+# supports <backend> <variant>: whether the backend implements the variant, the others must reject it
+supports() {
+    case $2 in
+        --tiles=* | --layout=*) [ $1 == main ] || [ $1 == main-omp ] ;;
+        # The out-of-core backend streams rows, it has no graph engine
+        graph) [ $1 != main-ooc ] ;;
+        *) true ;;
+    esac
+}
+
+# first_diff <cmd> <rows> <cols> <flags> <step>: report the first differing cell
+first_diff() {
+    local cmd=$1 rows=$2 cols=$3 flags=$4 step=$5
+    $BUILD/main $rows $cols f --seed=$SEED --steps=$step --kernel=scalar $FLAGS --dump=$TMP/ref.dump > /dev/null 2>&1
+    $cmd $rows $cols f --seed=$SEED --steps=$step $FLAGS $flags --dump=$TMP/got.dump > /dev/null 2>&1
+    local byte
+    byte=$(cmp "$TMP/ref.dump" "$TMP/got.dump" 2> /dev/null | awk '{print $5}' | tr -d ,)
+    if [ -z "$byte" ]; then
+        echo "        (dumps at step $step are identical, the trace itself differs)"
+        return
+    fi
+    local cell=$(((byte - 1) / 8))
+    local ref got
+    ref=$(od -An -t x4 -j $((cell * 8)) -N 8 "$TMP/ref.dump" | xargs)
+    got=$(od -An -t x4 -j $((cell * 8)) -N 8 "$TMP/got.dump" | xargs)
+    echo "        first differing cell: row $((cell / cols)) col $((cell % cols))" \
+        "(status contagion_t) expected [$ref] got [$got]"
+}
+
+# check <name> <cmd> <rows> <cols> <flags>
+check() {
+    local name=$1 cmd=$2 rows=$3 cols=$4 flags=$5
+    local golden=$GOLDEN/${rows}x${cols}.trace
+    checks=$((checks + 1))
+    if ! $cmd $rows $cols f --seed=$SEED --steps=$STEPS $FLAGS $flags --trace=$TMP/got.trace > /dev/null 2>&1; then
+        echo "[FAIL] $name ${rows}x${cols} $flags: run failed"
+        failures=$((failures + 1))
+        return
+    fi
+    local delta
+    delta=$(diff <(grep -v '^#' "$golden") <(grep -v '^#' "$TMP/got.trace"))
+    if [ -z "$delta" ]; then
+        echo "[ OK ] $name ${rows}x${cols} $flags"
+        return
+    fi
+    failures=$((failures + 1))
+    local expected got step
+    expected=$(echo "$delta" | grep '^<' | head -1 | cut -c3-)
+    got=$(echo "$delta" | grep '^>' | head -1 | cut -c3-)
+    step=$(echo "${expected:-$got}" | awk '{print $1}')
+    echo "[FAIL] $name ${rows}x${cols} $flags: first differing step $step"
+    echo "        expected: $expected"
+    echo "        got:      $got"
+    first_diff "$cmd" $rows $cols "$flags" $step
+}
+
+# check_rejected <name> <cmd> <rows> <cols> <flags>: the run must fail instead of ignoring the flags
+check_rejected() {
+    local name=$1 cmd=$2 rows=$3 cols=$4 flags=$5
+    checks=$((checks + 1))
+    if $cmd $rows $cols f --seed=$SEED --steps=1 $FLAGS $flags > /dev/null 2>&1; then
+        echo "[FAIL] $name ${rows}x${cols} $flags: not supported but accepted"
+        failures=$((failures + 1))
+    else
+        echo "[ OK ] $name ${rows}x${cols} $flags (rejected)"
+    fi
+}
+
+# check_dump <name> <cmd> <rows> <cols> <flags>: compares the grid after STEPS steps with the sequential backend
+check_dump() {
+    local name=$1 cmd=$2 rows=$3 cols=$4 flags=$5
+    checks=$((checks + 1))
+    $BUILD/main $rows $cols f --seed=$SEED --steps=$STEPS --kernel=scalar $FLAGS --dump=$TMP/ref.dump > /dev/null 2>&1
+    if ! $cmd $rows $cols f --seed=$SEED --steps=$STEPS $FLAGS $flags --dump=$TMP/got.dump > /dev/null 2>&1; then
+        echo "[FAIL] $name ${rows}x${cols} $flags: run failed"
+        failures=$((failures + 1))
+        return
+    fi
+    if cmp -s "$TMP/ref.dump" "$TMP/got.dump"; then
+        echo "[ OK ] $name ${rows}x${cols} $flags (final grid)"
+        return
+    fi
+    failures=$((failures + 1))
+    echo "[FAIL] $name ${rows}x${cols} $flags: final grids differ"
+    first_diff "$cmd" $rows $cols "$flags" $STEPS
+}
+
+if [ "$1" == "--update" ]; then
+    mkdir -p "$GOLDEN"
+    for size in $SIZES; do
+        rows=${size%x*}
+        cols=${size#*x}
+        $BUILD/main $rows $cols f --seed=$SEED --steps=$STEPS --kernel=scalar $FLAGS --trace=$GOLDEN/${size}.trace > /dev/null
+        echo "[INFO] Wrote $GOLDEN/${size}.trace"
+    done
+    exit 0
+fi
+
+for size in $SIZES; do
+    rows=${size%x*}
+    cols=${size#*x}
+    $BUILD/mkpop $rows $cols $TMP/${rows}x${cols}.pop --seed=$SEED > /dev/null
+    $BUILD/mkgraph $rows $cols $TMP/${rows}x${cols}.graph > /dev/null
+    for variant in $VARIANTS; do
+        flags=$(variant_flags "$variant" $rows $cols)
+        if ! $BUILD/main $rows $cols f --steps=0 $FLAGS $flags > /dev/null 2>&1; then
+            echo "[SKIP] $flags is not supported for ${rows}x${cols} here"
+            continue
+        fi
+        check "main" "$BUILD/main" $rows $cols "$flags"
+        if supports main-ooc "$variant"; then
+            check "main-ooc" "$BUILD/main-ooc" $rows $cols "$flags"
+            check "main-ooc" "$BUILD/main-ooc" $rows $cols "$flags --band=5"
+        else
+            check_rejected "main-ooc" "$BUILD/main-ooc" $rows $cols "$flags"
+        fi
+        for t in $THREADS; do
+            check "main-omp T=$t" "env OMP_NUM_THREADS=$t $BUILD/main-omp" $rows $cols "$flags"
+        done
+        if ! supports main-mpi "$variant"; then
+            check_rejected "main-mpi NP=2" "$MPIRUN -np 2 $BUILD/main-mpi" $rows $cols "$flags"
+            check_rejected "main-hyb NP=2" "$MPIRUN -np 2 $BUILD/main-hyb" $rows $cols "$flags"
+            continue
+        fi
+        for p in $PROCS; do
+            check "main-mpi NP=$p" "$MPIRUN -np $p $BUILD/main-mpi" $rows $cols "$flags"
+            for t in $THREADS; do
+                check "main-hyb NP=$p T=$t" "env OMP_NUM_THREADS=$t $MPIRUN -np $p $BUILD/main-hyb" $rows $cols "$flags"
+            done
+        done
+    done
+    for flags in $DUMP_VARIANTS; do
+        for t in $THREADS; do
+            check_dump "main-omp T=$t" "env OMP_NUM_THREADS=$t $BUILD/main-omp" $rows $cols "$flags"
+        done
+        check_rejected "main" "$BUILD/main" $rows $cols "$flags"
+        check_rejected "main-ooc" "$BUILD/main-ooc" $rows $cols "$flags"
+        check_rejected "main-mpi NP=2" "$MPIRUN -np 2 $BUILD/main-mpi" $rows $cols "$flags"
+        check_rejected "main-hyb NP=2" "$MPIRUN -np 2 $BUILD/main-hyb" $rows $cols "$flags"
+    done
+done
+
+# More threads than vertices leave some threads without a part of the graph
+$BUILD/mkgraph 2 3 $TMP/2x3.graph > /dev/null
+if $BUILD/main 2 3 f --steps=0 $FLAGS --graph=$TMP/2x3.graph > /dev/null 2>&1; then
+    check_dump "main-omp T=8" "env OMP_NUM_THREADS=8 $BUILD/main-omp" 2 3 "--graph=$TMP/2x3.graph"
+    check_dump "main-hyb NP=2 T=8" "env OMP_NUM_THREADS=8 $MPIRUN -np 2 $BUILD/main-hyb" 2 3 "--graph=$TMP/2x3.graph"
+fi
+
+echo "[INFO] $((checks - failures))/$checks golden checks passed"
+[ $failures -eq 0 ]
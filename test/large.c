@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "utils.h"
+#include "simulation.h"
+#include "options.h"
+#include "engine.h"
+
+/*
+    64-bit indexing checks for test/large.sh that need no grid past 2^31
+    cells in memory: a band of rows of a 50k x 50k and a 70k x 70k grid,
+    whose cell indices cross 2^31 and 2^32, is updated by every kernel as
+    an MPI rank would update its slab and compared cell by cell with the
+    rules applied from the 64-bit global index. Also checks the grid
+    sizes and the parsing of sides that don't fit an int.
+
+    Usage: large
+*/
+
+#define BAND_ROWS 6
+
+int failures = 0;
+int checks = 0;
+
+void check(bool ok, const char *name)
+{
+    checks++;
+    printf("[%s] %s\n", ok ? " OK " : "FAIL", name);
+    failures += !ok;
+}
+
+// The rules on row `i` of `band`, with the cell indices an int would hold if `as_int`
+void reference_row(Cell *band, Cell *out, int w, int i, long first_row, int time, uint64_t seed, bool as_int)
+{
+    Cell *neighbors[8];
+    Cell *above = &band[(size_t)(i - 1) * (size_t)w];
+    Cell *row = &band[(size_t)i * (size_t)w];
+    Cell *below = &band[(size_t)(i + 1) * (size_t)w];
+    for (int j = 0; j < w; j++)
+    {
+        out[j] = row[j];
+        int inf_n = 0;
+        if (row[j].status == SUSC_BLUE)
+        {
+            row_neighbors(above, row, below, w, j, neighbors);
+            inf_n = infected_neighbors(neighbors);
+        }
+        uint64_t global = (uint64_t)(first_row + i) * (uint64_t)w + (uint64_t)j;
+        if (as_int)
+            global = (uint64_t)(int64_t)(int32_t)(uint32_t)global;
+        CellRng rng;
+        cell_rng_seed(&rng, seed, time, global);
+        apply_rules(&out[j], inf_n, time, &rng);
+    }
+}
+
+// Cells of `a` and `b` with another status or contagion time
+long count_diffs(const Cell *a, const Cell *b, int n)
+{
+    long diffs = 0;
+    for (int j = 0; j < n; j++)
+        diffs += a[j].status != b[j].status || a[j].contagion_t != b[j].contagion_t;
+    return diffs;
+}
+
+/*
+    Rows [first_row, first_row + BAND_ROWS) of a `w` wide grid, with every
+    status and contagion times due for each rule at `time`, so most cells
+    draw.
+*/
+void fill_band(Cell *band, int w, int time)
+{
+    const CellStatus statuses[] = {SUSC_BLUE, SICK_NC_ORANGE, SICK_C_RED, ISOLATED_YELLOW};
+    init_cell_matrix(band, w, BAND_ROWS);
+    for (size_t k = 0; k < (size_t)w * BAND_ROWS; k++)
+    {
+        band[k].status = statuses[rand() % 4];
+        band[k].contagion_t = time - rand() % (rule_params.resolution_after + 1);
+    }
+}
+
+void check_band(int w, long first_row, const char *boundary)
+{
+    const int time = 40;
+    const uint64_t seed = 31415926;
+    Cell *band = malloc((size_t)w * BAND_ROWS * sizeof(Cell));
+    Cell *upd = malloc((size_t)w * BAND_ROWS * sizeof(Cell));
+    Cell *expected = malloc((size_t)w * sizeof(Cell));
+    Cell *truncated = malloc((size_t)w * sizeof(Cell));
+    Cell *ring = malloc(2 * (size_t)w * sizeof(Cell));
+    Cell *inplace = malloc((size_t)w * BAND_ROWS * sizeof(Cell));
+    fill_band(band, w, time);
+    char name[256];
+
+    for (int k = 0; k < KERNEL_KINDS; k++)
+    {
+        if (!kernel_supported((KernelKind)k) || !kernel_matches((KernelKind)k, w))
+            continue;
+        RowKernel kernel = kernel_table[k];
+        memcpy(inplace, band, (size_t)w * BAND_ROWS * sizeof(Cell));
+        engine_update_rows_inplace(kernel, inplace, w, 1, BAND_ROWS - 1, band, &band[(size_t)(BAND_ROWS - 1) * (size_t)w],
+                                   ring, time, seed, first_row);
+        long diffs = 0, inplace_diffs = 0, truncated_diffs = 0;
+        for (int i = 1; i < BAND_ROWS - 1; i++)
+        {
+            engine_update_row(kernel, band, upd, w, BAND_ROWS, i, time, seed, first_row);
+            reference_row(band, expected, w, i, first_row, time, seed, false);
+            reference_row(band, truncated, w, i, first_row, time, seed, true);
+            diffs += count_diffs(&upd[(size_t)i * (size_t)w], expected, w);
+            inplace_diffs += count_diffs(&inplace[(size_t)i * (size_t)w], expected, w);
+            truncated_diffs += count_diffs(truncated, expected, w);
+        }
+        snprintf(name, sizeof(name), "%s kernel, rows %ld-%ld of a %d wide grid (%s): %ld cells differ", kernel_names[k],
+                 first_row + 1, first_row + BAND_ROWS - 2, w, boundary, diffs);
+        check(diffs == 0, name);
+        snprintf(name, sizeof(name), "%s kernel, the same updated in place: %ld cells differ", kernel_names[k],
+                 inplace_diffs);
+        check(inplace_diffs == 0, name);
+        // Otherwise the band wouldn't tell an int index from a 64-bit one
+        snprintf(name, sizeof(name), "%s kernel, an int index would change %ld cells", kernel_names[k], truncated_diffs);
+        check(truncated_diffs > 0, name);
+    }
+    free(band);
+    free(upd);
+    free(expected);
+    free(truncated);
+    free(ring);
+    free(inplace);
+}
+
+// Whether parse_options() takes `rows` x `cols`
+bool parses(const char *rows, const char *cols)
+{
+    char const *argv[] = {"large", rows, cols, "f"};
+    Options opts;
+    return parse_options(4, argv, &opts, true) == 0;
+}
+
+int main(void)
+{
+    srand(31415926);
+
+    check(grid_cells(50000, 50000) == 2500000000ULL, "a 50k x 50k grid has 2.5G cells");
+    check(grid_cells(70000, 70000) == 4900000000ULL, "a 70k x 70k grid has 4.9G cells");
+    check(parses("50000", "50000"), "50k x 50k grids parse");
+    check(parses("2", "2147483647"), "INT_MAX columns parse");
+    check(!parses("2147483648", "2"), "2^31 rows are rejected");
+    check(!parses("2", "3000000000"), "3G columns are rejected");
+    check(!parses("50k", "2"), "sides that aren't numbers are rejected");
+
+    // The band's rows start past row 0, the middle rows cross the boundary
+    check_band(50000, 2147483648L / 50000 - 2, "cells past 2^31");
+    check_band(70000, 4294967296L / 70000 - 2, "cells past 2^32");
+
+    printf("[INFO] %d/%d large grid checks passed\n", checks - failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#!/bin/bash
+# Checks that grids past 2^31 cells or bytes are indexed with 64 bits.
+#
+# A grid past 2^31 cells (2.5G cells, 50 GB for 50k x 50k) doesn't fit in
+# memory here, so build/large (test/large.c) updates bands of rows whose
+# cell indices cross 2^31 and 2^32 and checks every kernel against the
+# rules applied from the 64-bit index. Past 2^31 bytes a grid still fits:
+# the sequential, OpenMP and out-of-core backends run a BIG grid (over
+# 2 GiB, in place with --update=rolling) and must write the same trace,
+# one that changes. The MPI backend can't hold the master grid and its
+# slabs at once at that size; build/main-mpi-chunked, built with a tiny
+# MPI_CHUNK_CELLS, must reproduce test/golden on the contact graph, whose
+# transfers are split in chunks.
+#
+# Usage: bash test/large.sh (make test-large builds what it needs)
+
+BUILD=${BUILD:-build}
+GOLDEN=${GOLDEN:-test/golden}
+SEED=${SEED:-31415926}
+BIG=${BIG:-10800x10000}
+BIG_STEPS=${BIG_STEPS:-6}
+SIZE=${SIZE:-120x84}
+STEPS=${STEPS:-120}
+PROCS=${PROCS:-"1 2 5"}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+failures=0
+checks=0
+
+# check <name> <command...>: passes when the command succeeds
+check() {
+    local name=$1
+    shift
+    checks=$((checks + 1))
+    if "$@"; then
+        echo "[ OK ] $name"
+    else
+        echo "[FAIL] $name"
+        failures=$((failures + 1))
+    fi
+}
+
+check "build/large: every kernel past 2^31 and 2^32 cells" $BUILD/large
+
+rows=${BIG%x*}
+cols=${BIG#*x}
+echo "Running a ${rows}x$cols grid ($((rows * cols * 20 / 1048576)) MiB) on three backends. This may take a while..."
+$BUILD/main $rows $cols f --seed=$SEED --steps=$BIG_STEPS --update=rolling --trace=$TMP/main.trace > /dev/null 2>&1
+OMP_NUM_THREADS=2 $BUILD/main-omp $rows $cols f --seed=$SEED --steps=$BIG_STEPS --update=rolling \
+    --trace=$TMP/omp.trace > /dev/null 2>&1
+$BUILD/main-ooc $rows $cols f --seed=$SEED --steps=$BIG_STEPS --trace=$TMP/ooc.trace > /dev/null 2>&1
+check "main ${rows}x$cols: the grid changes" \
+    test "$(grep -v '^#' $TMP/main.trace | awk '{ print $2 }' | sort -u | wc -l)" -gt 1
+check "main-omp ${rows}x$cols: trace matches main" diff -q $TMP/main.trace $TMP/omp.trace
+check "main-ooc ${rows}x$cols: trace matches main" diff -q $TMP/main.trace $TMP/ooc.trace
+
+rows=${SIZE%x*}
+cols=${SIZE#*x}
+$BUILD/mkgraph $rows $cols $TMP/$SIZE.graph > /dev/null
+for p in $PROCS; do
+    $MPIRUN -np $p $BUILD/main-mpi-chunked $rows $cols f --seed=$SEED --steps=$STEPS --graph=$TMP/$SIZE.graph \
+        --trace=$TMP/chunked.trace > /dev/null 2>&1
+    check "main-mpi-chunked NP=$p $SIZE graph: trace matches test/golden" \
+        diff <(grep -v '^#' $GOLDEN/$SIZE.trace) <(grep -v '^#' $TMP/chunked.trace)
+done
+
+echo "[INFO] $((checks - failures))/$checks large grid checks passed"
+[ $failures -eq 0 ]
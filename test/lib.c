@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "covidsim.h"
+
+/*
+    Host program of libcovidsim for test/lib.sh. Runs a grid through the
+    library and prints its trace without the hash column, read from the
+    series, then dumps the final grid. Fails if the status plane moves or
+    disagrees with the counts.
+
+    Usage: lib <rows> <cols> <seed> <steps> <dump> [kernel]
+*/
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 6)
+    {
+        fprintf(stderr, "Usage: %s <rows> <cols> <seed> <steps> <dump> [kernel]\n", argv[0]);
+        return 1;
+    }
+    CovidConfig config = {.rows = atoi(argv[1]), .cols = atoi(argv[2]), .seed = (unsigned int)strtoul(argv[3], NULL, 10),
+                          .kernel = argc > 6 ? argv[6] : NULL};
+    int steps = atoi(argv[4]);
+    CovidSim *sim = covidsim_create(&config);
+    if (sim == NULL)
+        return 1;
+    const uint8_t *status = covidsim_status(sim);
+    size_t n_cells = (size_t)covidsim_rows(sim) * (size_t)covidsim_cols(sim);
+    for (int t = 0; t < steps; t++)
+    {
+        if (covidsim_step(sim) != 0 || covidsim_time(sim) != t + 1)
+            return 1;
+        if (covidsim_status(sim) != status)
+        {
+            fprintf(stderr, "[ERR] The status plane moved at step %d\n", t + 1);
+            return 1;
+        }
+        // The plane and the counts describe the same grid
+        long counts[COVIDSIM_STATUS_KINDS] = {0};
+        for (size_t k = 0; k < n_cells; k++)
+            counts[status[k]]++;
+        for (int k = 0; k < COVIDSIM_STATUS_KINDS; k++)
+        {
+            if (counts[k] != covidsim_counts(sim)[k])
+            {
+                fprintf(stderr, "[ERR] Status %d: %ld cells in the plane, %ld counted at step %d\n", k, counts[k],
+                        (long)covidsim_counts(sim)[k], t + 1);
+                return 1;
+            }
+        }
+    }
+
+    CovidSeries series;
+    covidsim_series(sim, &series);
+    for (int64_t t = 0; t < series.length; t++)
+    {
+        printf("%lld", (long long)t);
+        for (int k = 0; k < COVIDSIM_STATUS_KINDS; k++)
+            printf(" %lld", (long long)series.counts[k][t]);
+        printf("\n");
+    }
+    int result = covidsim_snapshot(sim, argv[5]);
+    covidsim_destroy(sim);
+    return result == 0 ? 0 : 1;
+}
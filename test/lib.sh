@@ -0,0 +1,46 @@
+#!/bin/bash
+# Checks libcovidsim (src/libcovidsim.c) against the golden traces.
+#
+# Runs every size with each kernel through build/lib, a host program
+# linked with build/libcovidsim.so, and compares the series it reads with
+# test/golden (all but the hash column) and its snapshot with the --dump
+# of build/main.
+#
+# Usage: bash test/lib.sh
+
+BUILD=${BUILD:-build}
+GOLDEN=${GOLDEN:-test/golden}
+SEED=${SEED:-31415926}
+STEPS=${STEPS:-120}
+SIZES=${SIZES:-"12x12 60x60 120x84"}
+KERNELS=${KERNELS:-"scalar sse4.2 avx2 avx512 auto"}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+failures=0
+checks=0
+
+for size in $SIZES; do
+    rows=${size%x*}
+    cols=${size#*x}
+    $BUILD/main $rows $cols f --seed=$SEED --steps=$STEPS --dump=$TMP/ref.dump > /dev/null 2>&1
+    for kernel in $KERNELS; do
+        if ! $BUILD/main $rows $cols f --steps=0 --kernel=$kernel > /dev/null 2>&1; then
+            echo "[SKIP] --kernel=$kernel is not supported here"
+            continue
+        fi
+        checks=$((checks + 1))
+        if OMP_NUM_THREADS=2 $BUILD/lib $rows $cols $SEED $STEPS $TMP/got.dump $kernel > $TMP/got.trace &&
+            diff <(grep -v '^#' "$GOLDEN/$size.trace" | cut -d' ' -f1,3-) $TMP/got.trace > /dev/null &&
+            cmp -s $TMP/ref.dump $TMP/got.dump; then
+            echo "[ OK ] $size --kernel=$kernel"
+        else
+            echo "[FAIL] $size --kernel=$kernel"
+            failures=$((failures + 1))
+        fi
+    done
+done
+
+echo "[INFO] $((checks - failures))/$checks library checks passed"
+[ $failures -eq 0 ]
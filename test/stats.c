@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+/*
+    Statistical equivalence of two engines.
+
+    Reads two ensembles of traces (see src/trace.h), one run per seed, and
+    checks that the candidate draws from the same distribution as the
+    reference:
+        - Two-sample Kolmogorov-Smirnov tests on the epidemic curve (number
+          of sick cells) every STRIDE steps and on per-run summaries (peak,
+          time to peak, final cured and dead).
+        - A chi-square homogeneity test on the pooled final status counts,
+          with a Rao-Scott correction because the cells of one run are not
+          independent draws.
+    All p-values are Bonferroni corrected against ALPHA. Exit status is 1
+    when any test flags drift.
+
+    Usage: stats [--alpha=A] [--stride=S] <reference traces...> -- <candidate traces...>
+*/
+
+#define STATUS_KINDS 7
+#define MAX_STEPS 4096
+
+const char *status_names[STATUS_KINDS] = {"empty", "susc", "sick_nc", "sick_c", "isolated", "cured", "dead"};
+
+typedef struct Run
+{
+    int steps; // Number of trace lines, step 0 included
+    long counts[MAX_STEPS][STATUS_KINDS];
+} Run;
+
+typedef struct Ensemble
+{
+    int size;
+    Run *runs;
+} Ensemble;
+
+int read_trace(const char *path, Run *run)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "[ERR] Can't open trace '%s'\n", path);
+        return -1;
+    }
+    char line[512];
+    run->steps = 0;
+    while (fgets(line, sizeof(line), f) != NULL && run->steps < MAX_STEPS)
+    {
+        if (line[0] == '#')
+            continue;
+        int step;
+        char hash[32];
+        long *c = run->counts[run->steps];
+        if (sscanf(line, "%d %31s %ld %ld %ld %ld %ld %ld %ld", &step, hash,
+                   &c[0], &c[1], &c[2], &c[3], &c[4], &c[5], &c[6]) != 9)
+        {
+            fprintf(stderr, "[ERR] Malformed trace line in '%s': %s", path, line);
+            fclose(f);
+            return -1;
+        }
+        run->steps++;
+    }
+    fclose(f);
+    return 0;
+}
+
+long sick_at(Run *run, int step)
+{
+    long *c = run->counts[step];
+    return c[2] + c[3] + c[4];
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Kolmogorov distribution tail, Q_KS(lambda)
+double ks_q(double lambda)
+{
+    if (lambda < 1e-3)
+        return 1.0;
+    double sum = 0;
+    double sign = 1;
+    for (int j = 1; j <= 100; j++)
+    {
+        double term = sign * 2.0 * exp(-2.0 * j * j * lambda * lambda);
+        sum += term;
+        if (fabs(term) < 1e-12)
+            break;
+        sign = -sign;
+    }
+    return fmin(1.0, fmax(0.0, sum));
+}
+
+// Two-sample KS test, returns the p-value and stores the statistic in `d_out`
+double ks_test(double *a, int n, double *b, int m, double *d_out)
+{
+    qsort(a, (size_t)n, sizeof(double), compare_doubles);
+    qsort(b, (size_t)m, sizeof(double), compare_doubles);
+    int i = 0, j = 0;
+    double d = 0;
+    while (i < n && j < m)
+    {
+        double x = fmin(a[i], b[j]);
+        while (i < n && a[i] <= x)
+            i++;
+        while (j < m && b[j] <= x)
+            j++;
+        d = fmax(d, fabs((double)i / n - (double)j / m));
+    }
+    *d_out = d;
+    double ne = sqrt((double)n * m / (n + m));
+    return ks_q((ne + 0.12 + 0.11 / ne) * d);
+}
+
+// Regularized upper incomplete gamma Q(a, x), Numerical Recipes style
+double gamma_q(double a, double x)
+{
+    if (x <= 0)
+        return 1.0;
+    double gln = lgamma(a);
+    if (x < a + 1.0)
+    {
+        double ap = a, sum = 1.0 / a, del = sum;
+        for (int n = 0; n < 500; n++)
+        {
+            ap += 1.0;
+            del *= x / ap;
+            sum += del;
+            if (fabs(del) < fabs(sum) * 1e-14)
+                break;
+        }
+        return 1.0 - sum * exp(-x + a * log(x) - gln);
+    }
+    double b = x + 1.0 - a, c = 1.0 / 1e-300, d = 1.0 / b, h = d;
+    for (int i = 1; i < 500; i++)
+    {
+        double an = -i * (i - a);
+        b += 2.0;
+        d = an * d + b;
+        if (fabs(d) < 1e-300)
+            d = 1e-300;
+        c = b + an / c;
+        if (fabs(c) < 1e-300)
+            c = 1e-300;
+        d = 1.0 / d;
+        double del = d * c;
+        h *= del;
+        if (fabs(del - 1.0) < 1e-14)
+            break;
+    }
+    return exp(-x + a * log(x) - gln) * h;
+}
+
+/*
+    Chi-square homogeneity of the pooled final status counts, divided by
+    the mean design effect: the observed between-run variance of each
+    status share over the variance a multinomial sample would have.
+*/
+double chi_square_test(Ensemble *ref, Ensemble *cand, double *chi_out, int *dof_out)
+{
+    Ensemble *sets[2] = {ref, cand};
+    double pooled[2][STATUS_KINDS] = {{0}};
+    double deff_sum = 0;
+    int deff_n = 0;
+    for (int s = 0; s < 2; s++)
+    {
+        for (int r = 0; r < sets[s]->size; r++)
+        {
+            Run *run = &sets[s]->runs[r];
+            for (int k = 0; k < STATUS_KINDS; k++)
+                pooled[s][k] += (double)run->counts[run->steps - 1][k];
+        }
+    }
+
+    double total[2] = {0};
+    for (int s = 0; s < 2; s++)
+        for (int k = 0; k < STATUS_KINDS; k++)
+            total[s] += pooled[s][k];
+
+    for (int s = 0; s < 2; s++)
+    {
+        int n = sets[s]->size;
+        if (n < 2)
+            continue;
+        double cells = total[s] / n;
+        for (int k = 0; k < STATUS_KINDS; k++)
+        {
+            double p = pooled[s][k] / total[s];
+            if (p <= 0 || p >= 1)
+                continue;
+            double mean = 0, var = 0;
+            for (int r = 0; r < n; r++)
+                mean += (double)sets[s]->runs[r].counts[sets[s]->runs[r].steps - 1][k];
+            mean /= n;
+            for (int r = 0; r < n; r++)
+            {
+                double x = (double)sets[s]->runs[r].counts[sets[s]->runs[r].steps - 1][k] - mean;
+                var += x * x;
+            }
+            var /= (n - 1);
+            deff_sum += var / (cells * p * (1 - p));
+            deff_n++;
+        }
+    }
+    double deff = deff_n > 0 ? fmax(1.0, deff_sum / deff_n) : 1.0;
+
+    double chi = 0;
+    int used = 0;
+    for (int k = 0; k < STATUS_KINDS; k++)
+    {
+        double col = pooled[0][k] + pooled[1][k];
+        if (col <= 0)
+            continue;
+        used++;
+        for (int s = 0; s < 2; s++)
+        {
+            double expected = total[s] * col / (total[0] + total[1]);
+            chi += (pooled[s][k] - expected) * (pooled[s][k] - expected) / expected;
+        }
+    }
+    chi /= deff;
+    *chi_out = chi;
+    *dof_out = used - 1;
+    if (used < 2)
+        return 1.0;
+    return gamma_q((used - 1) / 2.0, chi / 2.0);
+}
+
+int load_ensemble(char const *argv[], int first, int last, Ensemble *e)
+{
+    e->size = last - first;
+    e->runs = malloc((size_t)e->size * sizeof(Run));
+    if (e->runs == NULL)
+        return -1;
+    for (int i = 0; i < e->size; i++)
+        if (read_trace(argv[first + i], &e->runs[i]) != 0)
+            return -1;
+    return 0;
+}
+
+// Summaries per run: peak sick, time to peak, final cured, final dead
+double run_summary(Run *run, int which)
+{
+    long peak = 0;
+    int peak_t = 0;
+    for (int t = 0; t < run->steps; t++)
+    {
+        if (sick_at(run, t) > peak)
+        {
+            peak = sick_at(run, t);
+            peak_t = t;
+        }
+    }
+    switch (which)
+    {
+    case 0:
+        return (double)peak;
+    case 1:
+        return (double)peak_t;
+    case 2:
+        return (double)run->counts[run->steps - 1][5];
+    default:
+        return (double)run->counts[run->steps - 1][6];
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    double alpha = 0.01;
+    int stride = 10;
+    int first = 1;
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0 && argv[first][2] != '\0'; first++)
+    {
+        if (strncmp(argv[first], "--alpha=", 8) == 0)
+            alpha = atof(argv[first] + 8);
+        else if (strncmp(argv[first], "--stride=", 9) == 0)
+            stride = atoi(argv[first] + 9);
+    }
+    int sep = first;
+    while (sep < argc && strcmp(argv[sep], "--") != 0)
+        sep++;
+    if (sep >= argc - 1 || sep == first || stride < 1)
+    {
+        fprintf(stderr, "Usage: %s [--alpha=A] [--stride=S] <reference traces...> -- <candidate traces...>\n", argv[0]);
+        return 2;
+    }
+
+    Ensemble ref, cand;
+    if (load_ensemble(argv, first, sep, &ref) != 0 || load_ensemble(argv, sep + 1, argc, &cand) != 0)
+        return 2;
+
+    int steps = ref.runs[0].steps;
+    for (int r = 0; r < ref.size; r++)
+        steps = (ref.runs[r].steps < steps) ? ref.runs[r].steps : steps;
+    for (int r = 0; r < cand.size; r++)
+        steps = (cand.runs[r].steps < steps) ? cand.runs[r].steps : steps;
+
+    const char *summary_names[4] = {"peak sick", "time to peak", "final cured", "final dead"};
+    int curve_tests = (steps - 1) / stride + 1;
+    int n_tests = curve_tests + 4 + 1;
+    double threshold = alpha / n_tests;
+
+    double *a = malloc((size_t)ref.size * sizeof(double));
+    double *b = malloc((size_t)cand.size * sizeof(double));
+    int drift = 0;
+
+    printf("[INFO] %d reference vs %d candidate runs, %d steps, %d tests, Bonferroni p < %.2e flags drift\n",
+           ref.size, cand.size, steps, n_tests, threshold);
+
+    for (int t = 0; t < steps; t += stride)
+    {
+        for (int r = 0; r < ref.size; r++)
+            a[r] = (double)sick_at(&ref.runs[r], t);
+        for (int r = 0; r < cand.size; r++)
+            b[r] = (double)sick_at(&cand.runs[r], t);
+        double d;
+        double p = ks_test(a, ref.size, b, cand.size, &d);
+        if (p < threshold)
+        {
+            drift++;
+            printf("[DRIFT] KS sick cells at step %4d: D = %.3f p = %.2e\n", t, d, p);
+        }
+    }
+    printf("[INFO] KS on the epidemic curve every %d steps done\n", stride);
+
+    for (int w = 0; w < 4; w++)
+    {
+        for (int r = 0; r < ref.size; r++)
+            a[r] = run_summary(&ref.runs[r], w);
+        for (int r = 0; r < cand.size; r++)
+            b[r] = run_summary(&cand.runs[r], w);
+        double d;
+        double p = ks_test(a, ref.size, b, cand.size, &d);
+        printf("[%s] KS %-13s D = %.3f p = %.2e\n", p < threshold ? "DRIFT" : " OK  ", summary_names[w], d, p);
+        drift += p < threshold;
+    }
+
+    double chi;
+    int dof;
+    double p = chi_square_test(&ref, &cand, &chi, &dof);
+    printf("[%s] chi-square final counts (%s..%s) X2 = %.2f dof = %d p = %.2e\n",
+           p < threshold ? "DRIFT" : " OK  ", status_names[0], status_names[STATUS_KINDS - 1], chi, dof, p);
+    drift += p < threshold;
+
+    free(a);
+    free(b);
+    free(ref.runs);
+    free(cand.runs);
+    printf("[INFO] %s\n", drift ? "Distribution drift detected" : "Candidate is statistically equivalent");
+    return drift ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+#!/bin/bash
+# Statistical-equivalence suite.
+#
+# Engines that are not bit-identical to the reference (other random streams,
+# batched or approximate kernels...) can't pass test/golden.sh. This runs the
+# reference and every candidate over an ensemble of seeds and compares the
+# resulting distributions with build/stats (KS tests on the epidemic curve,
+# chi-square on the final status counts). Candidates use seeds disjoint from
+# the reference ones so both ensembles are independent samples. To show
+# that the tests can flag drift at all, the reference is also run with
+# each DRIFTING rule spec (by default a deadlier disease), and build/stats
+# must reject those ensembles.
+#
+# Usage: bash test/stats.sh
+
+BUILD=${BUILD:-build}
+SIZE=${SIZE:-"60x60"}
+STEPS=${STEPS:-120}
+SEEDS=${SEEDS:-40}
+ALPHA=${ALPHA:-0.01}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+REFERENCE=${REFERENCE:-"$BUILD/main"}
+# name=command entries separated by ';'
+CANDIDATES=${CANDIDATES:-"main-omp=env OMP_NUM_THREADS=2 $BUILD/main-omp;main-mpi=$MPIRUN -np 2 $BUILD/main-mpi"}
+
+rows=${SIZE%x*}
+cols=${SIZE#*x}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+# name=rule spec entries separated by ';', each must be flagged
+sed 's/^\(death_chance_[a-z]*\) = .*/\1 = 60/' rules/default.rules > $TMP/deadly.rules
+DRIFTING=${DRIFTING-"deadly=$TMP/deadly.rules"}
+
+# ensemble <dir> <first seed> <cmd> [flags]
+ensemble() {
+    local dir=$1 first=$2 cmd=$3 flags=$4
+    mkdir -p "$dir"
+    for i in $(seq 0 $((SEEDS - 1))); do
+        if ! $cmd $rows $cols f --seed=$((first + i)) --steps=$STEPS $flags --trace=$dir/$i.trace > /dev/null 2>&1; then
+            echo "[ERR] '$cmd' failed with seed $((first + i))"
+            return 1
+        fi
+    done
+}
+
+echo "[INFO] Reference '$REFERENCE', $SEEDS seeds, ${rows}x${cols}, $STEPS steps"
+ensemble "$TMP/ref" 1 "$REFERENCE" || exit 1
+
+failures=0
+IFS=';' read -ra entries <<< "$CANDIDATES"
+for entry in "${entries[@]}"; do
+    name=${entry%%=*}
+    cmd=${entry#*=}
+    echo "[INFO] Candidate '$name'"
+    if ! ensemble "$TMP/$name" 100001 "$cmd"; then
+        failures=$((failures + 1))
+        continue
+    fi
+    if ! $BUILD/stats --alpha=$ALPHA "$TMP"/ref/*.trace -- "$TMP/$name"/*.trace; then
+        failures=$((failures + 1))
+    fi
+done
+
+IFS=';' read -ra entries <<< "$DRIFTING"
+for entry in "${entries[@]}"; do
+    name=${entry%%=*}
+    rules=${entry#*=}
+    echo "[INFO] Drifting candidate '$name' ($rules), must be flagged"
+    if ! ensemble "$TMP/$name" 100001 "$REFERENCE" "--rules=$rules"; then
+        failures=$((failures + 1))
+        continue
+    fi
+    if $BUILD/stats --alpha=$ALPHA "$TMP"/ref/*.trace -- "$TMP/$name"/*.trace; then
+        echo "[FAIL] '$name' drifts from the reference but passed"
+        failures=$((failures + 1))
+    else
+        echo "[ OK ] '$name' was flagged"
+    fi
+done
+
+[ $failures -eq 0 ]
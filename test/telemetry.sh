@@ -0,0 +1,96 @@
+#!/bin/bash
+# Checks the telemetry rings (src/telemetry.h) and build/covidsim-top.
+#
+# Runs the OpenMP, MPI and hybrid backends with --telemetry and --trace and
+# compares the counts covidsim-top reads with the trace, checks that the
+# traces still match test/golden, that a ring keeps the last records once
+# it wraps, that a running simulation can be watched and that the other
+# backends reject --telemetry.
+#
+# Usage: bash test/telemetry.sh
+
+BUILD=${BUILD:-build}
+GOLDEN=${GOLDEN:-test/golden}
+SEED=${SEED:-31415926}
+STEPS=${STEPS:-120}
+SIZE=${SIZE:-120x84}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+
+rows=${SIZE%x*}
+cols=${SIZE#*x}
+NAME=test-$$
+TMP=$(mktemp -d)
+trap 'kill $RUN 2> /dev/null; rm -rf "$TMP" /dev/shm/covidsim-$NAME*' EXIT
+
+failures=0
+checks=0
+
+# check <name> <command...>: passes when the command succeeds
+check() {
+    local name=$1
+    shift
+    checks=$((checks + 1))
+    if "$@"; then
+        echo "[ OK ] $name"
+    else
+        echo "[FAIL] $name"
+        failures=$((failures + 1))
+    fi
+}
+
+# counts <top report>: "<step> <counts...>" of the cells section
+counts() {
+    awk '/^Cells at step/ { printf "%s", $4; on = 1; next } on && NF >= 2 { printf " %s", $2 } END { printf "\n" }' "$1"
+}
+
+# expected <trace> <step>: the same from a trace
+expected() {
+    grep -v '^#' "$1" | awk -v s=$2 '$1 == s { printf "%s", $1; for (k = 3; k <= 9; k++) printf " %s", $k; printf "\n" }'
+}
+
+for backend in "omp" "mpi" "hyb"; do
+    for every in 1 16; do
+        if [ $backend == omp ]; then
+            OMP_NUM_THREADS=2 $BUILD/main-omp $rows $cols f --seed=$SEED --steps=$STEPS --trace=$TMP/run.trace \
+                --telemetry=$NAME:$every > /dev/null 2>&1
+        elif [ $backend == mpi ]; then
+            $MPIRUN -np 3 $BUILD/main-mpi $rows $cols f --seed=$SEED --steps=$STEPS --trace=$TMP/run.trace \
+                --telemetry=$NAME:$every > /dev/null 2>&1
+        else
+            $MPIRUN -np 2 -x OMP_NUM_THREADS=2 $BUILD/main-hyb $rows $cols f --seed=$SEED --steps=$STEPS --trace=$TMP/run.trace \
+                --telemetry=$NAME:$every > /dev/null 2>&1
+        fi
+        $BUILD/covidsim-top $NAME --once > $TMP/top.out 2>&1
+        check "main-$backend every $every: trace matches test/golden" \
+            diff <(grep -v '^#' $GOLDEN/$SIZE.trace) <(grep -v '^#' $TMP/run.trace)
+        check "main-$backend every $every: covidsim-top reads the counts of step $((STEPS / every * every))" \
+            diff <(expected $TMP/run.trace $((STEPS / every * every))) <(counts $TMP/top.out)
+        rm -f /dev/shm/covidsim-$NAME*
+    done
+done
+
+# Past TELEMETRY_SLOTS records the oldest are overwritten
+$BUILD/main-omp 12 12 f --seed=$SEED --steps=5000 --telemetry=$NAME > /dev/null 2>&1
+$BUILD/covidsim-top $NAME --once > $TMP/top.out 2>&1
+check "a full ring keeps its last 4096 records" \
+    test "$(awk '/^Step latency/ { on = 1; next } /^$/ { on = 0 } on { n += $4 } END { print n }' $TMP/top.out)" == 4096
+
+# A run can be watched as it goes
+$BUILD/main-omp 200 200 f --seed=$SEED --steps=1000000 --telemetry=$NAME > /dev/null 2>&1 &
+RUN=$!
+sleep 1
+$BUILD/covidsim-top $NAME --once > $TMP/top.out 2>&1
+check "covidsim-top watches a running simulation" \
+    awk '$1 == 0 && $2 > 0 && $NF == "running" { found = 1 } END { exit !found }' $TMP/top.out
+kill $RUN
+wait $RUN 2> /dev/null
+
+# The backends without a ring must refuse to run rather than publish nothing
+for backend in main main-ooc; do
+    check "$backend rejects --telemetry" \
+        bash -c "! $BUILD/$backend 12 12 f --steps=1 --telemetry=$NAME-$backend > /dev/null 2>&1 &&
+                 [ ! -e /dev/shm/covidsim-$NAME-$backend ]"
+done
+
+echo "[INFO] $((checks - failures))/$checks telemetry checks passed"
+[ $failures -eq 0 ]